@@ -4,6 +4,7 @@
 #include "pch.h" // Assuming Visual Studio precompiled header
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
 #include <chrono>
@@ -16,7 +17,22 @@
 #include <io.h>        // For _setmode
 #include <fcntl.h>     // For _O_U16TEXT
 #include <map>         // For std::map (used in verbose mode)
+#include <climits>     // For ULLONG_MAX
+#include <cmath>       // For std::pow, std::log (sketch sizing and estimates)
+#include <cerrno>      // For errno/ERANGE (count parsing)
+#include <cstring>     // For memcpy/memcmp (snapshot files)
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable> // For WorkerPool
+#include <atomic>
+#include <unordered_map> // For the aggregation tables (--rollup, --group-by)
+#include <unordered_set> // For --follow
+#include <memory>      // For std::unique_ptr
 #include <shellapi.h>  // For CommandLineToArgvW (used for main function fix)
+#include <sddl.h>      // For ConvertSidToStringSidW (used by --group-by owner)
+#include <intrin.h>    // For __cpuid, _xgetbv, _BitScanForward and the SSE/AVX2 intrinsics
 
 // -----------------------------------------------------------------------------
 // Forward declarations (default arguments specified here **only**)
@@ -106,45 +122,233 @@ std::vector<SortOption> parseSortOptions(const std::wstring& sortStr) {
     return options;
 }
 
-// Function to sort files based on sort options
-void sortFiles(std::vector<FileInfo>& files, const std::vector<SortOption>& sortOptions) {
-    std::sort(files.begin(), files.end(), [&sortOptions](const FileInfo& a, const FileInfo& b) {
-        for (const auto& option : sortOptions) {
-            bool result = false;
-            bool equal = false;
-            switch (option.field) {
-                case SortField::Path:
-                    result = a.path < b.path;
-                    equal = (a.path == b.path);
-                    break;
-                case SortField::Name: {
-                    size_t aLastSlash = a.path.find_last_of(L'\\');
-                    size_t bLastSlash = b.path.find_last_of(L'\\');
-                    std::wstring aName = (aLastSlash != std::wstring::npos) ? a.path.substr(aLastSlash + 1) : a.path;
-                    std::wstring bName = (bLastSlash != std::wstring::npos) ? b.path.substr(bLastSlash + 1) : b.path;
-                    result = aName < bName;
-                    equal = (aName == bName);
-                    break;
-                }
-                case SortField::Size:
-                    result = a.size < b.size;
-                    equal = (a.size == b.size);
-                    break;
-                case SortField::CreationDate:
-                    result = a.creationTime < b.creationTime;
-                    equal = (a.creationTime == b.creationTime);
-                    break;
-                case SortField::ModificationDate:
-                    result = a.modificationTime < b.modificationTime;
-                    equal = (a.modificationTime == b.modificationTime);
-                    break;
+// Ordering used by --sort: the sort options in turn, then path as the tie-breaker
+bool fileInfoLess(const FileInfo& a, const FileInfo& b, const std::vector<SortOption>& sortOptions) {
+    for (const auto& option : sortOptions) {
+        bool result = false;
+        bool equal = false;
+        switch (option.field) {
+            case SortField::Path:
+                result = a.path < b.path;
+                equal = (a.path == b.path);
+                break;
+            case SortField::Name: {
+                size_t aLastSlash = a.path.find_last_of(L'\\');
+                size_t bLastSlash = b.path.find_last_of(L'\\');
+                std::wstring aName = (aLastSlash != std::wstring::npos) ? a.path.substr(aLastSlash + 1) : a.path;
+                std::wstring bName = (bLastSlash != std::wstring::npos) ? b.path.substr(bLastSlash + 1) : b.path;
+                result = aName < bName;
+                equal = (aName == bName);
+                break;
+            }
+            case SortField::Size:
+                result = a.size < b.size;
+                equal = (a.size == b.size);
+                break;
+            case SortField::CreationDate:
+                result = a.creationTime < b.creationTime;
+                equal = (a.creationTime == b.creationTime);
+                break;
+            case SortField::ModificationDate:
+                result = a.modificationTime < b.modificationTime;
+                equal = (a.modificationTime == b.modificationTime);
+                break;
+        }
+        if (!equal) {
+            return option.ascending ? result : !result;
+        }
+    }
+    return a.path < b.path; // Default tie-breaker
+}
+
+// Compile-time sort chains. SortKey<Field, Ascending>::compare is a three-way comparison of one field
+// (negated when descending); SortChain applies its keys in order and falls back to the ascending path,
+// exactly as fileInfoLess does, but with every field access inlined and no per-comparison switch.
+inline std::wstring_view fileNameOf(const std::wstring& path) {
+    size_t lastSlash = path.find_last_of(L'\\');
+    return lastSlash != std::wstring::npos ? std::wstring_view(path).substr(lastSlash + 1) : std::wstring_view(path);
+}
+
+template <SortField Field, bool Ascending>
+struct SortKey {
+    static int compare(const FileInfo& a, const FileInfo& b) {
+        int result;
+        if constexpr (Field == SortField::Path) {
+            result = a.path.compare(b.path);
+        } else if constexpr (Field == SortField::Name) {
+            result = fileNameOf(a.path).compare(fileNameOf(b.path));
+        } else if constexpr (Field == SortField::Size) {
+            result = (a.size > b.size) - (a.size < b.size);
+        } else if constexpr (Field == SortField::CreationDate) {
+            result = (a.creationTime > b.creationTime) - (a.creationTime < b.creationTime);
+        } else {
+            result = (a.modificationTime > b.modificationTime) - (a.modificationTime < b.modificationTime);
+        }
+        return Ascending ? result : -result;
+    }
+};
+
+template <class... Keys>
+struct SortChain {
+    bool operator()(const FileInfo& a, const FileInfo& b) const {
+        int result = 0;
+        ((result = (result != 0 ? result : Keys::compare(a, b))), ...);
+        return result != 0 ? result < 0 : a.path < b.path;
+    }
+};
+
+// Chains longer than two keys keep the generic loop
+struct GenericSortChain {
+    const std::vector<SortOption>& options;
+    bool operator()(const FileInfo& a, const FileInfo& b) const { return fileInfoLess(a, b, options); }
+};
+
+// Calls fn with the SortChain instantiation for `options` (one or two keys), else a GenericSortChain
+template <class Fn, class... Keys>
+void dispatchSortChain(const std::vector<SortOption>& options, Fn& fn, size_t next = 0) {
+    if (next == options.size()) {
+        fn(SortChain<Keys...>());
+        return;
+    }
+    if constexpr (sizeof...(Keys) < 2) {
+        const SortOption& option = options[next];
+        auto extend = [&](auto key) { dispatchSortChain<Fn, Keys..., decltype(key)>(options, fn, next + 1); };
+        switch (option.field) {
+            case SortField::Path:
+                return option.ascending ? extend(SortKey<SortField::Path, true>()) : extend(SortKey<SortField::Path, false>());
+            case SortField::Name:
+                return option.ascending ? extend(SortKey<SortField::Name, true>()) : extend(SortKey<SortField::Name, false>());
+            case SortField::Size:
+                return option.ascending ? extend(SortKey<SortField::Size, true>()) : extend(SortKey<SortField::Size, false>());
+            case SortField::CreationDate:
+                return option.ascending ? extend(SortKey<SortField::CreationDate, true>()) : extend(SortKey<SortField::CreationDate, false>());
+            case SortField::ModificationDate:
+                return option.ascending ? extend(SortKey<SortField::ModificationDate, true>()) : extend(SortKey<SortField::ModificationDate, false>());
+        }
+    }
+    fn(GenericSortChain{options});
+}
+
+// std::sort over records exposing a FileInfo, with the comparator chain chosen once for the whole sort
+template <class Iterator, class InfoOf>
+void sortRange(Iterator first, Iterator last, const std::vector<SortOption>& options, InfoOf infoOf) {
+    auto run = [&](auto chain) {
+        std::sort(first, last, [&](const auto& a, const auto& b) { return chain(infoOf(a), infoOf(b)); });
+    };
+    dispatchSortChain(options, run);
+}
+
+// String sort key for multikey quicksort: a view of the path or name, the record it belongs to, and
+// the character at the current depth (cached once per partitioning pass)
+struct StringSortKey {
+    const wchar_t* text;
+    size_t length;
+    size_t index;
+    int cached;
+};
+
+// Character at `depth`, with the end of the string below every character (wstring::compare order)
+static inline int keyCharAt(const StringSortKey& key, size_t depth) {
+    return depth < key.length ? static_cast<int>(static_cast<std::make_unsigned_t<wchar_t>>(key.text[depth])) : -1;
+}
+
+static bool keySuffixLess(const StringSortKey& a, const StringSortKey& b, size_t depth) {
+    size_t common = std::min(a.length, b.length);
+    for (size_t i = depth; i < common; ++i) {
+        if (a.text[i] != b.text[i]) return std::char_traits<wchar_t>::lt(a.text[i], b.text[i]);
+    }
+    return a.length < b.length;
+}
+
+// Multikey quicksort (Bentley & Sedgewick): three-way partitions on one character position at a time,
+// so a shared prefix is scanned once per level rather than once per comparison. Keys in `keys` all
+// agree on their first `depth` characters.
+static void multikeyQuicksort(StringSortKey* keys, size_t count, size_t depth) {
+    while (count > 1) {
+        if (count < 16) {
+            for (size_t i = 1; i < count; ++i) {
+                for (size_t j = i; j > 0 && keySuffixLess(keys[j], keys[j - 1], depth); --j) std::swap(keys[j], keys[j - 1]);
             }
-            if (!equal) {
-                return option.ascending ? result : !result;
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) keys[i].cached = keyCharAt(keys[i], depth);
+        int a = keys[0].cached, b = keys[count / 2].cached, c = keys[count - 1].cached;
+        int pivot = std::max(std::min(a, b), std::min(std::max(a, b), c));
+
+        // Dijkstra partition: [0, lt) below, [lt, i) equal, (gt, count) above the pivot character
+        size_t lt = 0, i = 0, gt = count;
+        while (i < gt) {
+            if (keys[i].cached < pivot) std::swap(keys[lt++], keys[i++]);
+            else if (keys[i].cached > pivot) std::swap(keys[i], keys[--gt]);
+            else ++i;
+        }
+        multikeyQuicksort(keys, lt, depth);
+        multikeyQuicksort(keys + gt, count - gt, depth);
+        if (pivot < 0) return; // Equal keys that ended here are identical
+        keys += lt;
+        count = gt - lt;
+        ++depth;
+    }
+}
+
+// Sorts any records that expose a FileInfo through `infoOf` in fileInfoLess order. A leading path or
+// name key goes through multikey quicksort; the remaining keys only order runs of equal strings.
+template <class Record, class InfoOf>
+void sortRecords(std::vector<Record>& records, const std::vector<SortOption>& sortOptions, InfoOf infoOf) {
+    if (sortOptions.empty() || records.size() < 2 ||
+        (sortOptions.front().field != SortField::Path && sortOptions.front().field != SortField::Name)) {
+        sortRange(records.begin(), records.end(), sortOptions, infoOf);
+        return;
+    }
+
+    const bool byName = sortOptions.front().field == SortField::Name;
+    std::vector<StringSortKey> keys;
+    keys.reserve(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        const std::wstring& path = infoOf(records[i]).path;
+        size_t start = 0;
+        if (byName) {
+            size_t lastSlash = path.find_last_of(L'\\');
+            if (lastSlash != std::wstring::npos) start = lastSlash + 1;
+        }
+        keys.push_back({path.c_str() + start, path.length() - start, i, 0});
+    }
+    multikeyQuicksort(keys.data(), keys.size(), 0);
+
+    // Runs of equal keys, in ascending key order; reversed as whole runs for a descending first key
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t begin = 0; begin < keys.size();) {
+        size_t end = begin + 1;
+        while (end < keys.size() && keys[end].length == keys[begin].length &&
+               std::char_traits<wchar_t>::compare(keys[end].text, keys[begin].text, keys[begin].length) == 0) ++end;
+        runs.emplace_back(begin, end);
+        begin = end;
+    }
+    if (!sortOptions.front().ascending) std::reverse(runs.begin(), runs.end());
+
+    // A lone name key leaves only fileInfoLess's ascending path tie-breaker, which is a string sort too
+    const bool pathTieBreakOnly = byName && sortOptions.size() == 1;
+    std::vector<Record> sorted;
+    sorted.reserve(records.size());
+    for (const auto& run : runs) {
+        size_t first = sorted.size(), length = run.second - run.first;
+        if (length > 1 && pathTieBreakOnly) {
+            for (size_t k = run.first; k < run.second; ++k) {
+                const std::wstring& path = infoOf(records[keys[k].index]).path;
+                keys[k].text = path.c_str();
+                keys[k].length = path.length();
             }
+            multikeyQuicksort(keys.data() + run.first, length, 0);
         }
-        return a.path < b.path; // Default tie-breaker
-    });
+        for (size_t k = run.first; k < run.second; ++k) sorted.push_back(std::move(records[keys[k].index]));
+        if (length > 1 && !pathTieBreakOnly) sortRange(sorted.begin() + first, sorted.end(), sortOptions, infoOf);
+    }
+    records.swap(sorted);
+}
+
+// Function to sort files based on sort options
+void sortFiles(std::vector<FileInfo>& files, const std::vector<SortOption>& sortOptions) {
+    sortRecords(files, sortOptions, [](const FileInfo& info) -> const FileInfo& { return info; });
 }
 
 // Function to parse date string into time_point
@@ -181,25 +385,6 @@ std::optional<std::chrono::system_clock::time_point> parseDateTime(const std::ws
     return std::nullopt;
 }
 
-// Filter files based on date criteria
-std::vector<FileInfo> filterFilesByDate(
-    const std::vector<FileInfo>& files,
-    const std::optional<std::chrono::system_clock::time_point>& createdStart,
-    const std::optional<std::chrono::system_clock::time_point>& createdEnd,
-    const std::optional<std::chrono::system_clock::time_point>& modifiedStart,
-    const std::optional<std::chrono::system_clock::time_point>& modifiedEnd) {
-    std::vector<FileInfo> filtered;
-    for (const auto& file : files) {
-        bool include = true;
-        if (createdStart && file.creationTime < *createdStart) include = false;
-        if (createdEnd && file.creationTime >= *createdEnd) include = false;
-        if (modifiedStart && file.modificationTime < *modifiedStart) include = false;
-        if (modifiedEnd && file.modificationTime >= *modifiedEnd) include = false;
-        if (include) filtered.push_back(file);
-    }
-    return filtered;
-}
-
 // Helper function to check if a string equals any of multiple options
 bool strEqualsAny(const std::wstring& str, std::initializer_list<const wchar_t*> options) {
     for (const auto& option : options) {
@@ -210,146 +395,2785 @@ bool strEqualsAny(const std::wstring& str, std::initializer_list<const wchar_t*>
     return false;
 } 
 
-class FileFinder {
+// Offset between the FILETIME epoch (1601-01-01) and the Unix epoch, in seconds
+constexpr long long kFileTimeEpochOffset = 11644473600LL;
+constexpr long long kFileTimeTicksPerSecond = 10000000LL;
+
+ULONGLONG fileTimeTicks(const FILETIME& ft) {
+    ULARGE_INTEGER value;
+    value.LowPart = ft.dwLowDateTime;
+    value.HighPart = ft.dwHighDateTime;
+    return value.QuadPart;
+}
+
+ULONGLONG timePointToFileTimeTicks(const std::chrono::system_clock::time_point& timePoint) {
+    long long seconds = static_cast<long long>(std::chrono::system_clock::to_time_t(timePoint)) + kFileTimeEpochOffset;
+    return seconds > 0 ? static_cast<ULONGLONG>(seconds) * kFileTimeTicksPerSecond : 0;
+}
+
+// Whole seconds, same as the FileTimeToSystemTime/_mkgmtime round trip (which yields -1 before 1970)
+std::chrono::system_clock::time_point fileTimeTicksToTimePoint(ULONGLONG ticks) {
+    long long seconds = static_cast<long long>(ticks / kFileTimeTicksPerSecond) - kFileTimeEpochOffset;
+    return std::chrono::system_clock::from_time_t(seconds < 0 ? static_cast<time_t>(-1) : static_cast<time_t>(seconds));
+}
+
+std::chrono::system_clock::time_point fileTimeToTimePoint(const FILETIME& ft) {
+    return fileTimeTicksToTimePoint(fileTimeTicks(ft));
+}
+
+uintmax_t fileSizeOf(const WIN32_FIND_DATAW& findData) {
+    ULARGE_INTEGER fileSize;
+    fileSize.LowPart = findData.nFileSizeLow;
+    fileSize.HighPart = findData.nFileSizeHigh;
+    return fileSize.QuadPart;
+}
+
+FileInfo makeFileInfo(const std::wstring& fullPath, const WIN32_FIND_DATAW& findData) {
+    FileInfo info;
+    info.path = fullPath;
+    info.creationTime = fileTimeToTimePoint(findData.ftCreationTime);
+    info.modificationTime = fileTimeToTimePoint(findData.ftLastWriteTime);
+    info.size = fileSizeOf(findData);
+    return info;
+}
+
+// Parses a plain decimal count; nullopt for anything else, including values too large for 64 bits
+std::optional<uint64_t> parseCount(const std::wstring& text) {
+    if (text.empty() || !std::all_of(text.begin(), text.end(), iswdigit)) return std::nullopt;
+    errno = 0;
+    unsigned long long value = wcstoull(text.c_str(), nullptr, 10);
+    if (errno == ERANGE) return std::nullopt;
+    return value;
+}
+
+// Parses a size such as "4096", "100K", "1.5G" or "2MB" (binary units: K, M, G, T)
+std::optional<uintmax_t> parseSize(const std::wstring& sizeStr) {
+    std::wsmatch match;
+    static const std::wregex sizeFormat(L"^(\\d+(?:\\.\\d+)?)\\s*([KMGT]?)B?$", std::regex_constants::icase);
+    if (!std::regex_match(sizeStr, match, sizeFormat)) return std::nullopt;
+    double value = wcstod(match[1].str().c_str(), nullptr); // Overflows to HUGE_VAL, rejected below
+    std::wstring unit = match[2].str();
+    int shift = 0;
+    if (!unit.empty()) {
+        switch (towupper(unit[0])) {
+            case L'K': shift = 10; break;
+            case L'M': shift = 20; break;
+            case L'G': shift = 30; break;
+            case L'T': shift = 40; break;
+        }
+    }
+    double bytes = value * static_cast<double>(1ULL << shift);
+    if (bytes >= 18446744073709551615.0) return std::nullopt;
+    return static_cast<uintmax_t>(bytes);
+}
+
+// 64-bit hash of a string: FNV-1a over the UTF-16 code units, then the splitmix64 finalizer so the
+// high bits (used for HyperLogLog register selection) are well mixed
+static inline uint64_t mixHash64(uint64_t hash) {
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebull;
+    return hash ^ (hash >> 31);
+}
+
+// `seed` chains hashes, e.g. a file name hashed onto its directory's hash
+uint64_t hash64(const wchar_t* text, size_t length, uint64_t seed = 0xcbf29ce484222325ull) {
+    uint64_t hash = seed;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint16_t>(text[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return mixHash64(hash);
+}
+
+uint64_t hash64(const std::wstring& text) {
+    return hash64(text.c_str(), text.length());
+}
+
+// Filters evaluated against the raw enumeration data, before any path string or FileInfo is built.
+// Date bounds are whole seconds, so comparing FILETIME ticks gives the same verdict as comparing
+// the truncated FileInfo times. Size bounds are inclusive.
+struct EntryFilter {
+    std::optional<ULONGLONG> createdStart, createdEnd;
+    std::optional<ULONGLONG> modifiedStart, modifiedEnd;
+    std::optional<uintmax_t> minSize, maxSize;
+    std::optional<uint64_t> sampleThreshold; // --sample: keep entries whose path hash is below this
+
+    bool active() const {
+        return createdStart || createdEnd || modifiedStart || modifiedEnd || minSize || maxSize || sampleThreshold;
+    }
+
+    // `sampleSeed` is the hash of the entry's directory, so selection is a deterministic function of the path
+    bool passes(const WIN32_FIND_DATAW& findData, uint64_t sampleSeed) const {
+        if (sampleThreshold && hash64(findData.cFileName, wcslen(findData.cFileName), sampleSeed) >= *sampleThreshold) return false;
+        if (minSize || maxSize) {
+            uintmax_t size = fileSizeOf(findData);
+            if (minSize && size < *minSize) return false;
+            if (maxSize && size > *maxSize) return false;
+        }
+        if (createdStart || createdEnd) {
+            ULONGLONG created = fileTimeTicks(findData.ftCreationTime);
+            if (createdStart && created < *createdStart) return false;
+            if (createdEnd && created >= *createdEnd) return false;
+        }
+        if (modifiedStart || modifiedEnd) {
+            ULONGLONG modified = fileTimeTicks(findData.ftLastWriteTime);
+            if (modifiedStart && modified < *modifiedStart) return false;
+            if (modifiedEnd && modified >= *modifiedEnd) return false;
+        }
+        return true;
+    }
+};
+
+struct SearchOptions {
+    bool useRegex = false;
+    bool shallow = false;
+    bool debug = false;
+    bool pathMatch = false;
+    bool dedupLinks = false;
+    int pathOrder = 0; // --sort p: deliver matches in ascending (1) or descending (-1) path order
+    size_t threads = 1; // Above 1, sinks that can merge are fed by a parallel walk
+    size_t adaptiveStart = 0; // Nonzero: a parallel walk starts with this many threads running and adapts
+    double pace = 0; // --pace: directory listings (metadata lookups for a list) per second, 0 for no limit
+    std::vector<std::wstring> excludes;
+    EntryFilter filter;
+};
+
+// One matching directory entry handed from the walker to a sink. The full path is assembled on
+// demand in a buffer shared by the whole directory, so sinks that only need the enumeration data
+// never build a path string.
+class WalkEntry {
 public:
-    static std::vector<FileInfo> findFiles(
-        const std::wstring& directory,
-        const std::wstring& pattern,
-        bool useRegex = false,
-        bool shallow = false,
-        bool debug = false,
-        bool pathMatch = false) {
-        std::vector<FileInfo> results;
-        std::wregex regexPattern;
+    WalkEntry(const std::wstring& directory, const WIN32_FIND_DATAW& data, std::wstring& pathBuffer, size_t prefixLength)
+        : directory(directory), data(data), pathBuffer(pathBuffer), prefixLength(prefixLength) {}
 
-        if (debug) {
-            std::wcout << L"Directory: " << directory << std::endl;
-            std::wcout << L"Pattern: " << pattern << std::endl;
+    const std::wstring& directory;
+    const WIN32_FIND_DATAW& data;
+
+    const std::wstring& fullPath() const {
+        pathBuffer.resize(prefixLength);
+        pathBuffer += data.cFileName;
+        return pathBuffer;
+    }
+
+private:
+    std::wstring& pathBuffer;
+    size_t prefixLength;
+};
+
+// Default sink: materializes every match as a FileInfo for sorting, printing and --execute
+class CollectSink {
+public:
+    void onMatch(const WalkEntry& entry) {
+        results.push_back(makeFileInfo(entry.fullPath(), entry.data));
+    }
+
+    void merge(CollectSink&& other) {
+        if (results.empty()) results = std::move(other.results);
+        else results.insert(results.end(), std::make_move_iterator(other.results.begin()), std::make_move_iterator(other.results.end()));
+    }
+
+    std::vector<FileInfo> results;
+};
+
+// -----------------------------------------------------------------------------
+// Case-insensitive literal search over UTF-16 names and paths. Candidate positions are found by
+// comparing the first and last needle characters against a whole vector of start positions at
+// once (as in SIMD memmem implementations); only candidates are verified character by character.
+// Folding is ASCII-only, which is what std::regex icase does under the default "C" locale.
+// The needle passed in must already be folded.
+// -----------------------------------------------------------------------------
+inline wchar_t foldAscii(wchar_t c) {
+    return (c >= L'A' && c <= L'Z') ? static_cast<wchar_t>(c + (L'a' - L'A')) : c;
+}
+
+std::wstring foldAscii(const std::wstring& str) {
+    std::wstring folded(str);
+    for (auto& c : folded) c = foldAscii(c);
+    return folded;
+}
+
+static bool equalsFolded(const wchar_t* text, const wchar_t* foldedNeedle, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (foldAscii(text[i]) != foldedNeedle[i]) return false;
+    }
+    return true;
+}
+
+static size_t findLiteralScalar(const wchar_t* haystack, size_t length, const wchar_t* needle, size_t needleLength) {
+    if (needleLength == 0) return 0;
+    if (needleLength > length) return std::wstring::npos;
+    const wchar_t first = needle[0];
+    const wchar_t last = needle[needleLength - 1];
+    for (size_t i = 0, end = length - needleLength; i <= end; ++i) {
+        if (foldAscii(haystack[i]) == first && foldAscii(haystack[i + needleLength - 1]) == last &&
+            equalsFolded(haystack + i, needle, needleLength)) {
+            return i;
         }
+    }
+    return std::wstring::npos;
+}
 
-        try {
-            if (useRegex) {
-                regexPattern = std::wregex(pattern, std::regex_constants::icase);
+#if defined(_M_X64) || defined(_M_IX86)
+static inline __m128i foldAscii128(__m128i chars) {
+    __m128i offset = _mm_sub_epi16(chars, _mm_set1_epi16(L'A'));
+    __m128i isUpper = _mm_cmpeq_epi16(_mm_min_epu16(offset, _mm_set1_epi16(25)), offset);
+    return _mm_or_si128(chars, _mm_and_si128(isUpper, _mm_set1_epi16(0x20)));
+}
+
+static inline __m256i foldAscii256(__m256i chars) {
+    __m256i offset = _mm256_sub_epi16(chars, _mm256_set1_epi16(L'A'));
+    __m256i isUpper = _mm256_cmpeq_epi16(_mm256_min_epu16(offset, _mm256_set1_epi16(25)), offset);
+    return _mm256_or_si256(chars, _mm256_and_si256(isUpper, _mm256_set1_epi16(0x20)));
+}
+
+// Verifies the candidates in a movemask result (two mask bits per UTF-16 lane), returning the
+// offset of the first real match within the block or npos
+static inline size_t verifyCandidates(unsigned mask, const wchar_t* block, const wchar_t* needle, size_t needleLength) {
+    while (mask) {
+        unsigned long bit;
+        _BitScanForward(&bit, mask);
+        if (equalsFolded(block + bit / 2, needle, needleLength)) return bit / 2;
+        mask &= ~(3u << bit);
+    }
+    return std::wstring::npos;
+}
+
+static size_t findLiteralSse41(const wchar_t* haystack, size_t length, const wchar_t* needle, size_t needleLength) {
+    if (needleLength == 0) return 0;
+    if (needleLength > length) return std::wstring::npos;
+    const __m128i first = _mm_set1_epi16(static_cast<short>(needle[0]));
+    const __m128i last = _mm_set1_epi16(static_cast<short>(needle[needleLength - 1]));
+    const size_t starts = length - needleLength + 1;
+    size_t i = 0;
+    for (; i + 8 <= starts; i += 8) {
+        __m128i blockFirst = foldAscii128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i)));
+        __m128i blockLast = foldAscii128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + needleLength - 1)));
+        __m128i hits = _mm_and_si128(_mm_cmpeq_epi16(blockFirst, first), _mm_cmpeq_epi16(blockLast, last));
+        size_t offset = verifyCandidates(static_cast<unsigned>(_mm_movemask_epi8(hits)), haystack + i, needle, needleLength);
+        if (offset != std::wstring::npos) return i + offset;
+    }
+    size_t tail = findLiteralScalar(haystack + i, length - i, needle, needleLength);
+    return tail == std::wstring::npos ? tail : i + tail;
+}
+
+static size_t findLiteralAvx2(const wchar_t* haystack, size_t length, const wchar_t* needle, size_t needleLength) {
+    if (needleLength == 0) return 0;
+    if (needleLength > length) return std::wstring::npos;
+    const __m256i first = _mm256_set1_epi16(static_cast<short>(needle[0]));
+    const __m256i last = _mm256_set1_epi16(static_cast<short>(needle[needleLength - 1]));
+    const size_t starts = length - needleLength + 1;
+    size_t i = 0;
+    for (; i + 16 <= starts; i += 16) {
+        __m256i blockFirst = foldAscii256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i)));
+        __m256i blockLast = foldAscii256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i + needleLength - 1)));
+        __m256i hits = _mm256_and_si256(_mm256_cmpeq_epi16(blockFirst, first), _mm256_cmpeq_epi16(blockLast, last));
+        size_t offset = verifyCandidates(static_cast<unsigned>(_mm256_movemask_epi8(hits)), haystack + i, needle, needleLength);
+        if (offset != std::wstring::npos) return i + offset;
+    }
+    size_t tail = findLiteralSse41(haystack + i, length - i, needle, needleLength);
+    return tail == std::wstring::npos ? tail : i + tail;
+}
+#endif
+
+using LiteralSearchFn = size_t (*)(const wchar_t*, size_t, const wchar_t*, size_t);
+
+// Picks the widest kernel the CPU (and, for AVX2, the OS) supports
+static LiteralSearchFn selectLiteralSearch() {
+#if defined(_M_X64) || defined(_M_IX86)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5)) return findLiteralAvx2;
+    }
+    if (sse41) return findLiteralSse41;
+#endif
+    return findLiteralScalar;
+}
+
+// Position of the first occurrence of the folded needle, or npos
+size_t findLiteralIgnoreCase(const wchar_t* haystack, size_t length, const std::wstring& foldedNeedle) {
+    static const LiteralSearchFn search = selectLiteralSearch();
+    return search(haystack, length, foldedNeedle.data(), foldedNeedle.length());
+}
+
+// Counters for --stats. Each walker thread keeps its own copy; they are merged when the walk ends.
+struct SearchStats {
+    uint64_t directories = 0;
+    uint64_t entries = 0;
+    uint64_t prefilterTested = 0;
+    uint64_t prefilterPassed = 0;
+    uint64_t regexRuns = 0;
+    uint64_t matches = 0;
+    uint64_t duplicateLinks = 0;
+    // Parallel walks: threads running at the end out of the pool's; adaptive walks add the peak and
+    // how often the controller changed its mind
+    uint64_t walkerThreads = 0, walkerPool = 0, walkerPeak = 0, walkerAdjustments = 0;
+
+    void merge(const SearchStats& other) {
+        directories += other.directories;
+        entries += other.entries;
+        prefilterTested += other.prefilterTested;
+        prefilterPassed += other.prefilterPassed;
+        regexRuns += other.regexRuns;
+        matches += other.matches;
+        duplicateLinks += other.duplicateLinks;
+        walkerThreads = std::max(walkerThreads, other.walkerThreads);
+        walkerPool = std::max(walkerPool, other.walkerPool);
+        walkerPeak = std::max(walkerPeak, other.walkerPeak);
+        walkerAdjustments += other.walkerAdjustments;
+    }
+};
+
+// Literal requirements of a pattern: every match starts with `prefix`, ends with `suffix` and
+// contains `segments` in this order between them (all folded). With `exactLength` the subject must
+// be exactly the prefix. When `decides` is set the plan is the whole verdict and no regex runs.
+struct LiteralPlan {
+    std::wstring prefix, suffix;
+    std::vector<std::wstring> segments;
+    bool exactLength = false;
+    bool decides = false;
+
+    bool active() const {
+        return decides || exactLength || !prefix.empty() || !suffix.empty() || !segments.empty();
+    }
+
+    bool admits(const wchar_t* subject, size_t length) const {
+        if (exactLength && length != prefix.length()) return false;
+        if (prefix.length() + suffix.length() > length) return false;
+        if (!equalsFolded(subject, prefix.data(), prefix.length())) return false;
+        if (!equalsFolded(subject + length - suffix.length(), suffix.data(), suffix.length())) return false;
+        size_t pos = prefix.length();
+        const size_t end = length - suffix.length();
+        for (const auto& segment : segments) {
+            size_t found = findLiteralIgnoreCase(subject + pos, end - pos, segment);
+            if (found == std::wstring::npos) return false;
+            pos += found + segment.length();
+        }
+        return true;
+    }
+};
+
+// The file pattern and any --exclude patterns compiled into a single regex, so each name is
+// tested once for the combined include/exclude verdict. Exclusions become a negative lookahead
+// at the start of the subject; without exclusions the regex is exactly the include pattern.
+// Combining them renumbers capture groups, so regexes with backreferences cannot be combined.
+class PatternMatcher {
+public:
+    // True when an ECMAScript regex refers back to a capture group (\1 to \9, or \k<name>)
+    static bool hasBackreference(const std::wstring& regex) {
+        for (size_t i = 0; i + 1 < regex.length(); ++i) {
+            if (regex[i] != L'\\') continue;
+            wchar_t next = regex[++i];
+            if ((next >= L'1' && next <= L'9') || next == L'k') return true;
+        }
+        return false;
+    }
+
+    // Throws std::regex_error for an invalid pattern
+    PatternMatcher(const std::wstring& pattern, const std::vector<std::wstring>& excludes, bool useRegex, bool pathMatch) {
+        std::wstring regexStr;
+        if (excludes.empty()) {
+            regexStr = useRegex ? pattern : dosPatternToRegex(pattern, pathMatch);
+        } else {
+            // DOS patterns match the whole name unless matching against the full path
+            bool anchored = !useRegex && !pathMatch;
+            auto term = [&](const std::wstring& p) {
+                std::wstring body = useRegex ? p : dosPatternToRegex(p, true);
+                return anchored ? L"(?:" + body + L")$" : L"[\\s\\S]*?(?:" + body + L")";
+            };
+            regexStr = L"^(?!";
+            for (size_t i = 0; i < excludes.size(); ++i) {
+                if (i > 0) regexStr += L'|';
+                regexStr += term(excludes[i]);
+            }
+            regexStr += L')';
+            regexStr += term(pattern);
+        }
+        regex = std::wregex(regexStr, std::regex_constants::icase);
+        if (useRegex) {
+            plan = analyzeRegex(pattern);
+        } else {
+            plan = analyzeDosPattern(pattern, pathMatch);
+            // Exclusions still need the combined regex for survivors
+            if (!excludes.empty()) plan.decides = false;
+        }
+    }
+
+    bool matches(const std::wstring& subject, SearchStats& stats) const {
+        return matches(subject.c_str(), subject.length(), stats);
+    }
+
+    bool matches(const wchar_t* subject, SearchStats& stats) const {
+        return matches(subject, wcslen(subject), stats);
+    }
+
+    bool matches(const wchar_t* subject, size_t length, SearchStats& stats) const {
+        if (plan.active()) {
+            ++stats.prefilterTested;
+            if (!plan.admits(subject, length)) return false;
+            ++stats.prefilterPassed;
+            if (plan.decides) return true;
+        }
+        ++stats.regexRuns;
+        return std::regex_search(subject, subject + length, regex);
+    }
+
+private:
+    std::wregex regex;
+    LiteralPlan plan;
+
+    // A DOS pattern without '?' is a sequence of literals joined by '*', so the plan decides it
+    // exactly (anchored at both ends unless matching full paths). With '?' only the literal runs at
+    // the ends and the longest inner run are kept as a prefilter. (Names with U+2028/U+2029, which
+    // the regex '.' does not cross, are the one case where a deciding plan is more permissive.)
+    static LiteralPlan analyzeDosPattern(const std::wstring& pattern, bool pathMatch) {
+        std::vector<std::wstring> runs;
+        size_t start = 0;
+        while (true) {
+            size_t end = pattern.find_first_of(L"*?", start);
+            runs.push_back(foldAscii(pattern.substr(start, end == std::wstring::npos ? std::wstring::npos : end - start)));
+            if (end == std::wstring::npos) break;
+            start = end + 1;
+        }
+
+        LiteralPlan plan;
+        const bool anchored = !pathMatch;
+        if (anchored) {
+            plan.prefix = runs.front();
+            if (runs.size() == 1) {
+                plan.exactLength = true;
             } else {
-                std::wstring regexStr = dosPatternToRegex(pattern, pathMatch);
-                regexPattern = std::wregex(regexStr, std::regex_constants::icase);
+                plan.suffix = runs.back();
+            }
+        }
+        size_t innerBegin = anchored ? 1 : 0;
+        size_t innerEnd = anchored ? runs.size() - 1 : runs.size();
+        if (pattern.find(L'?') == std::wstring::npos) {
+            for (size_t i = innerBegin; i < innerEnd; ++i) {
+                if (!runs[i].empty()) plan.segments.push_back(runs[i]);
+            }
+            plan.decides = true;
+        } else {
+            std::wstring longest;
+            for (size_t i = innerBegin; i < innerEnd; ++i) {
+                if (runs[i].length() > longest.length()) longest = runs[i];
+            }
+            if (!longest.empty()) plan.segments.push_back(longest);
+        }
+        return plan;
+    }
+
+    // Conservative scan of the top-level sequence of an ECMAScript regex. Groups, classes, '.',
+    // class escapes and assertions simply end the current literal run; a quantifier makes its
+    // character optional or repeatable. Top-level alternation gives up, so every literal kept is
+    // implied by the regex. '^' and '$' turn the first and last runs into prefix and suffix.
+    static LiteralPlan analyzeRegex(const std::wstring& pattern) {
+        LiteralPlan plan;
+        std::vector<std::wstring> runs;
+        std::wstring run;
+        bool atStart = false;     // The current run begins right after a leading '^'
+        bool sawPrefix = false;
+        const size_t n = pattern.length();
+        size_t i = 0;
+        if (n > 0 && pattern[0] == L'^') { atStart = true; i = 1; }
+
+        auto endRun = [&]() {
+            if (atStart && !sawPrefix) { plan.prefix = run; sawPrefix = true; }
+            else if (!run.empty()) runs.push_back(run);
+            run.clear();
+            atStart = false;
+        };
+
+        while (i < n) {
+            wchar_t c = pattern[i];
+            bool literalAtom = false;
+            if (c == L'|') {
+                return LiteralPlan();
+            } else if (c == L'(') {
+                int depth = 0;
+                for (; i < n; ++i) {
+                    if (pattern[i] == L'\\') { ++i; continue; }
+                    if (pattern[i] == L'[') { i = skipClass(pattern, i); continue; }
+                    if (pattern[i] == L'(') ++depth;
+                    else if (pattern[i] == L')' && --depth == 0) break;
+                }
+                ++i;
+                endRun();
+            } else if (c == L'[') {
+                i = skipClass(pattern, i) + 1;
+                endRun();
+            } else if (c == L'\\') {
+                if (i + 1 >= n) return LiteralPlan();
+                wchar_t e = pattern[i + 1];
+                i += 2;
+                if (iswalnum(e)) {
+                    if (e == L'x') i += 2;
+                    else if (e == L'u') i += 4;
+                    else if (e == L'c') i += 1;
+                    else if (iswdigit(e)) while (i < n && iswdigit(pattern[i])) ++i;
+                    endRun();
+                } else {
+                    run += foldAscii(e);
+                    literalAtom = true;
+                }
+            } else if (c == L'$' && i + 1 == n) {
+                if (atStart && !sawPrefix) {
+                    plan.prefix = run;
+                    plan.exactLength = true;
+                    sawPrefix = true;
+                } else {
+                    plan.suffix = run;
+                }
+                run.clear();
+                break;
+            } else if (c == L'.' || c == L'^' || c == L'$') {
+                ++i;
+                endRun();
+            } else if (c == L'*' || c == L'+' || c == L'?' || c == L'{') {
+                return LiteralPlan(); // Quantifier without an atom; leave it to the regex
+            } else {
+                run += foldAscii(c);
+                literalAtom = true;
+                ++i;
+            }
+
+            if (i >= n) break;
+            wchar_t q = pattern[i];
+            if (q != L'*' && q != L'+' && q != L'?' && q != L'{') continue;
+            bool optional = (q == L'*' || q == L'?');
+            if (q == L'{') {
+                size_t close = pattern.find(L'}', i);
+                if (close == std::wstring::npos || close == i + 1 || !iswdigit(pattern[i + 1])) return LiteralPlan();
+                optional = std::stoul(pattern.substr(i + 1, close - i - 1)) == 0;
+                i = close + 1;
+            } else {
+                ++i;
+            }
+            if (i < n && pattern[i] == L'?') ++i; // Lazy quantifier
+            if (literalAtom && optional) run.pop_back();
+            endRun();
+        }
+        if (!run.empty()) endRun();
+
+        std::wstring longest;
+        for (const auto& r : runs) {
+            if (r.length() > longest.length()) longest = r;
+        }
+        if (!longest.empty()) plan.segments.push_back(longest);
+        return plan;
+    }
+
+    // Index of the ']' closing the class that opens at `open` (ECMAScript: "[]" is an empty class)
+    static size_t skipClass(const std::wstring& pattern, size_t open) {
+        size_t i = open + 1;
+        if (i < pattern.length() && pattern[i] == L'^') ++i;
+        for (; i < pattern.length(); ++i) {
+            if (pattern[i] == L'\\') { ++i; continue; }
+            if (pattern[i] == L']') break;
+        }
+        return i;
+    }
+
+    static std::wstring dosPatternToRegex(const std::wstring& pattern, bool pathMatch) {
+        std::wstring result;
+        result.reserve(pattern.length() * 2);
+        if (!pathMatch) result += L'^';
+
+        for (wchar_t c : pattern) {
+            switch (c) {
+                case L'*': result += L".*"; break;
+                case L'?': result += L"."; break;
+                case L'.': case L'[': case L']': case L'(': case L')':
+                case L'{': case L'}': case L'+': case L'^': case L'$':
+                case L'|': case L'\\':
+                    result += L'\\';
+                    result += c;
+                    break;
+                default: result += c; break;
             }
-        } catch (const std::regex_error& e) {
-            std::string what_str = e.what();
-            std::wcerr << L"Invalid regex pattern: " << std::wstring(what_str.begin(), what_str.end()) << std::endl;
-            return results;
         }
+        if (!pathMatch) result += L'$';
+        return result;
+    }
+};
+
+// Running totals over matched files. Each walker thread keeps its own and they are merged at the end.
+struct AggregateStats {
+    uint64_t count = 0;
+    uintmax_t totalSize = 0;
+    uintmax_t minSize = UINTMAX_MAX;
+    uintmax_t maxSize = 0;
+    ULONGLONG oldestModified = ULLONG_MAX; // FILETIME ticks
+    ULONGLONG newestModified = 0;
+
+    void add(uintmax_t size, ULONGLONG modified) {
+        ++count;
+        totalSize += size;
+        minSize = std::min(minSize, size);
+        maxSize = std::max(maxSize, size);
+        oldestModified = std::min(oldestModified, modified);
+        newestModified = std::max(newestModified, modified);
+    }
+
+    void merge(const AggregateStats& other) {
+        count += other.count;
+        totalSize += other.totalSize;
+        minSize = std::min(minSize, other.minSize);
+        maxSize = std::max(maxSize, other.maxSize);
+        oldestModified = std::min(oldestModified, other.oldestModified);
+        newestModified = std::max(newestModified, other.newestModified);
+    }
+};
+
+// Sink for listings whose matches already arrive in output order (--sort p): each one is printed or
+// executed as soon as it is found, so nothing is collected
+class StreamSink {
+public:
+    explicit StreamSink(std::function<void(const FileInfo&)> emit) : emit(std::move(emit)) {}
+
+    void onMatch(const WalkEntry& entry) {
+        emit(makeFileInfo(entry.fullPath(), entry.data));
+        ++count;
+    }
+
+    size_t count = 0;
+
+private:
+    std::function<void(const FileInfo&)> emit;
+};
+
+// Sink for --count/--sum-size: updates counters straight from the enumeration data, so no path,
+// FileInfo or result vector is ever built
+class AggregateSink {
+public:
+    void onMatch(const WalkEntry& entry) {
+        totals.add(fileSizeOf(entry.data), fileTimeTicks(entry.data.ftLastWriteTime));
+    }
+
+    void merge(const AggregateSink& other) {
+        totals.merge(other.totals);
+    }
+
+    AggregateStats totals;
+};
+
+// Sink for --sample: sample totals plus the sum of squared sizes needed for the variance of the
+// scaled-up estimate (kept as double; squares of large sizes overflow 64 bits)
+class SampleSink {
+public:
+    void onMatch(const WalkEntry& entry) {
+        uintmax_t size = fileSizeOf(entry.data);
+        totals.add(size, fileTimeTicks(entry.data.ftLastWriteTime));
+        sumSquares += static_cast<double>(size) * static_cast<double>(size);
+    }
+
+    void merge(const SampleSink& other) {
+        totals.merge(other.totals);
+        sumSquares += other.sumSquares;
+    }
+
+    AggregateStats totals;
+    double sumSquares = 0;
+};
+
+// One line of an aggregate report. `info` mirrors the totals as a FileInfo (key as path, total as
+// size, oldest/newest modification as created/modified) so --sort applies to reports unchanged.
+struct AggregateRow {
+    FileInfo info;
+    AggregateStats stats;
+
+    AggregateRow(const std::wstring& key, const AggregateStats& totals) : stats(totals) {
+        info.path = key;
+        info.size = totals.totalSize;
+        info.creationTime = fileTimeTicksToTimePoint(totals.oldestModified);
+        info.modificationTime = fileTimeTicksToTimePoint(totals.newestModified);
+    }
+};
+
+void sortAggregateRows(std::vector<AggregateRow>& rows, const std::vector<SortOption>& sortOptions) {
+    sortRecords(rows, sortOptions, [](const AggregateRow& row) -> const FileInfo& { return row.info; });
+}
+
+// Hash aggregation of matched files by key. Consecutive entries usually share a key (same
+// directory, same extension run), so the last slot is remembered to skip most lookups.
+class AggregateTable {
+public:
+    // The cached slot points into the source's map, so copies start without one; a move hands its
+    // nodes (and with them the cache) over and leaves the source without one
+    AggregateTable() = default;
+    AggregateTable(const AggregateTable& other) : groups(other.groups) {}
+    AggregateTable(AggregateTable&& other) noexcept
+        : groups(std::move(other.groups)), currentKey(other.currentKey), current(other.current) {
+        other.currentKey = nullptr;
+        other.current = nullptr;
+    }
+    AggregateTable& operator=(AggregateTable other) noexcept {
+        groups.swap(other.groups);
+        std::swap(currentKey, other.currentKey);
+        std::swap(current, other.current);
+        return *this;
+    }
+
+    AggregateStats& slot(const std::wstring& key) {
+        if (!current || key != *currentKey) {
+            auto it = groups.try_emplace(key).first;
+            currentKey = &it->first;
+            current = &it->second;
+        }
+        return *current;
+    }
+
+    void merge(const AggregateTable& other) {
+        for (const auto& pair : other.groups) groups[pair.first].merge(pair.second);
+    }
+
+    std::vector<AggregateRow> rows() const {
+        std::vector<AggregateRow> result;
+        result.reserve(groups.size());
+        for (const auto& pair : groups) result.emplace_back(pair.first, pair.second);
+        return result;
+    }
+
+    std::unordered_map<std::wstring, AggregateStats> groups;
+
+private:
+    const std::wstring* currentKey = nullptr;
+    AggregateStats* current = nullptr;
+};
+
+// Sink for --rollup: totals of the files directly in each directory, keyed by directory path.
+// Memory grows with the number of directories holding matches, not with the number of files.
+class RollupSink {
+public:
+    void onMatch(const WalkEntry& entry) {
+        table.slot(entry.directory).add(fileSizeOf(entry.data), fileTimeTicks(entry.data.ftLastWriteTime));
+    }
+
+    void merge(const RollupSink& other) {
+        table.merge(other.table);
+    }
+
+    // Adds every directory's totals into its ancestors up to its root in one post-order pass (deepest
+    // level first), then returns the directories at most `maxDepth` levels below their root
+    std::vector<AggregateRow> rollup(const std::vector<std::wstring>& roots, std::optional<size_t> maxDepth) {
+        auto& directories = table.groups;
+        auto rootOf = [&roots](const std::wstring& dir) -> const std::wstring& {
+            for (const auto& root : roots) {
+                if (dir.compare(0, root.length(), root) == 0 &&
+                    (dir.length() == root.length() || dir[root.length()] == L'\\' || (!root.empty() && root.back() == L'\\'))) {
+                    return root;
+                }
+            }
+            return roots.front();
+        };
+        auto depthOf = [&rootOf](const std::wstring& dir) {
+            const std::wstring& root = rootOf(dir);
+            size_t depth = std::count(dir.begin() + std::min(root.length(), dir.length()), dir.end(), L'\\');
+            if (dir.length() > root.length() && !root.empty() && root.back() == L'\\') ++depth;
+            return depth;
+        };
+        std::vector<std::vector<std::wstring>> levels;
+        for (const auto& pair : directories) {
+            size_t depth = depthOf(pair.first);
+            if (levels.size() <= depth) levels.resize(depth + 1);
+            levels[depth].push_back(pair.first);
+        }
+        for (size_t depth = levels.size(); depth-- > 1;) {
+            for (const auto& dir : levels[depth]) {
+                const std::wstring& root = rootOf(dir);
+                std::wstring parent = dir.substr(0, dir.find_last_of(L'\\'));
+                if (parent.length() < root.length()) parent = root;
+                auto inserted = directories.try_emplace(parent);
+                if (inserted.second) levels[depth - 1].push_back(parent);
+                inserted.first->second.merge(directories[dir]);
+            }
+        }
+        std::vector<AggregateRow> rows;
+        for (const auto& pair : directories) {
+            if (!maxDepth || depthOf(pair.first) <= *maxDepth) rows.emplace_back(pair.first, pair.second);
+        }
+        return rows;
+    }
+
+private:
+    AggregateTable table;
+};
+
+enum class GroupField {
+    Extension,
+    Directory,
+    Owner,
+    ModifiedMonth
+};
+
+std::optional<GroupField> parseGroupField(const std::wstring& fieldStr) {
+    if (fieldStr == L"ext") return GroupField::Extension;
+    if (fieldStr == L"dir") return GroupField::Directory;
+    if (fieldStr == L"owner") return GroupField::Owner;
+    if (fieldStr == L"mtime-month") return GroupField::ModifiedMonth;
+    return std::nullopt;
+}
+
+// Derives the --group-by/--distinct key of a matched file. Only the owner key costs anything beyond
+// the enumeration data (one security query per file, names cached by SID). One instance per thread.
+class GroupKey {
+public:
+    explicit GroupKey(GroupField field) : field(field) {}
+
+    const std::wstring& of(const WalkEntry& entry) {
+        switch (field) {
+            case GroupField::Extension: {
+                const wchar_t* dot = wcsrchr(entry.data.cFileName, L'.');
+                key = (dot && dot != entry.data.cFileName) ? foldAscii(std::wstring(dot)) : L"(none)";
+                return key;
+            }
+            case GroupField::Directory:
+                return entry.directory;
+            case GroupField::Owner:
+                return ownerOf(entry.fullPath());
+            case GroupField::ModifiedMonth:
+                return monthOf(fileTimeTicks(entry.data.ftLastWriteTime));
+        }
+        return key;
+    }
+
+private:
+    GroupField field;
+    std::wstring key;
+    std::unordered_map<std::string, std::wstring> ownerNames; // Raw SID bytes -> account name
+    std::vector<BYTE> securityBuffer;
+    ULONGLONG monthStart = 0, monthEnd = 0;                   // Local month of `monthKey`, FILETIME ticks
+    std::wstring monthKey;
+
+    const std::wstring& ownerOf(const std::wstring& path) {
+        static const std::wstring unknown = L"(unknown)";
+        DWORD needed = 0;
+        if (securityBuffer.empty()) securityBuffer.resize(256);
+        if (!GetFileSecurityW(path.c_str(), OWNER_SECURITY_INFORMATION, securityBuffer.data(), static_cast<DWORD>(securityBuffer.size()), &needed)) {
+            if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) return unknown;
+            securityBuffer.resize(needed);
+            if (!GetFileSecurityW(path.c_str(), OWNER_SECURITY_INFORMATION, securityBuffer.data(), needed, &needed)) return unknown;
+        }
+        PSID owner = nullptr;
+        BOOL defaulted = FALSE;
+        if (!GetSecurityDescriptorOwner(securityBuffer.data(), &owner, &defaulted) || !owner) return unknown;
+
+        std::string sidBytes(static_cast<const char*>(owner), GetLengthSid(owner));
+        auto it = ownerNames.find(sidBytes);
+        if (it != ownerNames.end()) return it->second;
+
+        wchar_t name[256], domain[256];
+        DWORD nameLength = 256, domainLength = 256;
+        SID_NAME_USE use;
+        std::wstring account;
+        if (LookupAccountSidW(nullptr, owner, name, &nameLength, domain, &domainLength, &use)) {
+            account = domainLength ? std::wstring(domain) + L'\\' + name : std::wstring(name);
+        } else {
+            LPWSTR sidString = nullptr;
+            if (ConvertSidToStringSidW(owner, &sidString)) {
+                account = sidString;
+                LocalFree(sidString);
+            } else {
+                account = unknown;
+            }
+        }
+        return ownerNames.emplace(sidBytes, account).first->second;
+    }
+
+    // "YYYY-MM" in local time, as the listing shows dates; the month's tick range is cached
+    const std::wstring& monthOf(ULONGLONG ticks) {
+        if (!monthKey.empty() && ticks >= monthStart && ticks < monthEnd) return monthKey;
+        time_t tt = std::chrono::system_clock::to_time_t(fileTimeTicksToTimePoint(ticks));
+        struct tm timeinfo;
+        localtime_s(&timeinfo, &tt);
+        wchar_t buffer[8];
+        wcsftime(buffer, 8, L"%Y-%m", &timeinfo);
+        monthKey = buffer;
+
+        struct tm boundary = {};
+        boundary.tm_year = timeinfo.tm_year;
+        boundary.tm_mon = timeinfo.tm_mon;
+        boundary.tm_mday = 1;
+        boundary.tm_isdst = -1;
+        monthStart = timePointToFileTimeTicks(std::chrono::system_clock::from_time_t(mktime(&boundary)));
+        boundary = {};
+        boundary.tm_year = timeinfo.tm_year;
+        boundary.tm_mon = timeinfo.tm_mon + 1;
+        boundary.tm_mday = 1;
+        boundary.tm_isdst = -1;
+        monthEnd = timePointToFileTimeTicks(std::chrono::system_clock::from_time_t(mktime(&boundary)));
+        return monthKey;
+    }
+};
+
+// Sink for --group-by: streaming hash aggregation keyed by the chosen field
+class GroupBySink {
+public:
+    explicit GroupBySink(GroupField field) : keys(field) {}
+
+    void onMatch(const WalkEntry& entry) {
+        table.slot(keys.of(entry)).add(fileSizeOf(entry.data), fileTimeTicks(entry.data.ftLastWriteTime));
+    }
+
+    void merge(const GroupBySink& other) {
+        table.merge(other.table);
+    }
+
+    std::vector<AggregateRow> rows() const {
+        return table.rows();
+    }
+
+private:
+    GroupKey keys;
+    AggregateTable table;
+};
+
+enum class HistogramKind {
+    Size,
+    Age
+};
+
+// Number of significant bits in `value` (0 for 0), i.e. the index of its log2 size bucket
+static inline unsigned bitWidth(uintmax_t value) {
+#if defined(_M_X64)
+    unsigned long index;
+    return _BitScanReverse64(&index, value) ? index + 1 : 0;
+#else
+    unsigned width = 0;
+    while (value) { ++width; value >>= 1; }
+    return width;
+#endif
+}
+
+// Sink for --histogram: fixed arrays of per-bucket counters filled from the enumeration data, so a
+// match costs a bucket index and two additions. Each walker thread fills its own; merge() adds them up.
+class HistogramSink {
+public:
+    // Size buckets: 0 bytes, then [2^(k-1), 2^k) for k = 1..64.
+    // Age buckets: modified in the future, then the ranges in kAgeBoundsDays (last one open-ended).
+    static constexpr size_t kSizeBuckets = 65;
+    static constexpr size_t kAgeBuckets = 9;
+
+    struct Bucket {
+        std::wstring label;
+        uint64_t lower;                // Bytes or days, inclusive
+        std::optional<uint64_t> upper; // Exclusive; none for the open-ended bucket
+        uint64_t count;
+        uintmax_t totalSize;
+    };
+
+    HistogramSink(HistogramKind kind, ULONGLONG nowTicks) : kind(kind), nowTicks(nowTicks) {}
+
+    void onMatch(const WalkEntry& entry) {
+        uintmax_t size = fileSizeOf(entry.data);
+        size_t bucket = (kind == HistogramKind::Size) ? bitWidth(size) : ageBucket(fileTimeTicks(entry.data.ftLastWriteTime));
+        ++counts[bucket];
+        sizes[bucket] += size;
+    }
+
+    void merge(const HistogramSink& other) {
+        for (size_t i = 0; i < kSizeBuckets; ++i) {
+            counts[i] += other.counts[i];
+            sizes[i] += other.sizes[i];
+        }
+    }
+
+    // Size histograms are trimmed to the populated range; age histograms always list every bucket
+    // except "future" when it is empty
+    std::vector<Bucket> buckets() const {
+        std::vector<Bucket> result;
+        if (kind == HistogramKind::Size) {
+            size_t first = 0, last = kSizeBuckets;
+            while (first < kSizeBuckets && !counts[first]) ++first;
+            while (last > first && !counts[last - 1]) --last;
+            for (size_t i = first; i < last; ++i) {
+                uint64_t lower = i ? (1ull << (i - 1)) : 0;
+                std::optional<uint64_t> upper;
+                if (i < 64) upper = 1ull << i;
+                std::wstring label = i ? formatBucketBytes(lower) + L" - " + (upper ? formatBucketBytes(*upper) : L"") : L"0 B";
+                result.push_back({label, lower, upper, counts[i], sizes[i]});
+            }
+            return result;
+        }
+        static const wchar_t* labels[kAgeBuckets] = {L"future", L"< 1 day", L"1-7 days", L"1-4 weeks", L"1-3 months",
+                                                     L"3-12 months", L"1-2 years", L"2-5 years", L"> 5 years"};
+        for (size_t i = counts[0] ? 0 : 1; i < kAgeBuckets; ++i) {
+            uint64_t lower = i ? kAgeBoundsDays[i - 1] : 0;
+            std::optional<uint64_t> upper;
+            if (i && i < kAgeBuckets - 1) upper = kAgeBoundsDays[i];
+            result.push_back({labels[i], lower, upper, counts[i], sizes[i]});
+        }
+        return result;
+    }
+
+private:
+    static constexpr uint64_t kAgeBoundsDays[kAgeBuckets - 1] = {0, 1, 7, 30, 90, 365, 730, 1825};
+    static constexpr ULONGLONG kTicksPerDay = 86400ull * kFileTimeTicksPerSecond;
+
+    HistogramKind kind;
+    ULONGLONG nowTicks;
+    uint64_t counts[kSizeBuckets] = {};
+    uintmax_t sizes[kSizeBuckets] = {};
+
+    size_t ageBucket(ULONGLONG modified) const {
+        if (modified > nowTicks) return 0;
+        uint64_t days = (nowTicks - modified) / kTicksPerDay;
+        size_t bucket = 1;
+        while (bucket < kAgeBuckets - 1 && days >= kAgeBoundsDays[bucket]) ++bucket;
+        return bucket;
+    }
+
+    // Bucket bounds are powers of two, so they always print as a whole number of units
+    static std::wstring formatBucketBytes(uint64_t bytes) {
+        static const wchar_t* units[] = {L"B", L"KB", L"MB", L"GB", L"TB", L"PB", L"EB"};
+        size_t unit = 0;
+        while (bytes >= 1024 && unit < 6) { bytes /= 1024; ++unit; }
+        return std::to_wstring(bytes) + L" " + units[unit];
+    }
+};
+
+// KLL quantile sketch over 64-bit values. Level h holds items of weight 2^h; when a level reaches its
+// capacity it is sorted and every other item (random offset) is promoted. Retains O(k) items whatever
+// the stream length, with a normalized rank error of roughly 1.7/k; sketches of the same k merge.
+class KllSketch {
+public:
+    explicit KllSketch(size_t k = 200) : k(k) {
+        grow();
+    }
+
+    void add(uint64_t value) {
+        compactors[0].push_back(value);
+        if (++size >= maxSize) compress();
+    }
+
+    void merge(const KllSketch& other) {
+        while (compactors.size() < other.compactors.size()) grow();
+        for (size_t h = 0; h < other.compactors.size(); ++h) {
+            compactors[h].insert(compactors[h].end(), other.compactors[h].begin(), other.compactors[h].end());
+        }
+        size += other.size;
+        while (size >= maxSize) compress();
+    }
+
+    // Smallest retained value whose weighted rank reaches q (0..1) of the stream
+    uint64_t quantile(double q) const {
+        std::vector<std::pair<uint64_t, uint64_t>> weighted; // value, weight
+        weighted.reserve(size);
+        uint64_t total = 0;
+        for (size_t h = 0; h < compactors.size(); ++h) {
+            for (uint64_t value : compactors[h]) weighted.emplace_back(value, 1ull << h);
+            total += compactors[h].size() << h;
+        }
+        if (weighted.empty()) return 0;
+        std::sort(weighted.begin(), weighted.end());
+        double target = q * total;
+        uint64_t cumulative = 0;
+        for (const auto& item : weighted) {
+            cumulative += item.second;
+            if (cumulative >= target) return item.first;
+        }
+        return weighted.back().first;
+    }
+
+private:
+    size_t k;
+    std::vector<std::vector<uint64_t>> compactors;
+    size_t size = 0;
+    size_t maxSize = 0;
+    uint64_t coin = 0x9e3779b97f4a7c15ull; // Deterministic so repeated runs report the same values
+
+    // Capacities shrink by 2/3 per level below the top, never below 2
+    size_t capacity(size_t level) const {
+        double scaled = k * std::pow(2.0 / 3.0, static_cast<double>(compactors.size() - level - 1));
+        return std::max<size_t>(2, static_cast<size_t>(std::ceil(scaled)));
+    }
+
+    void grow() {
+        compactors.emplace_back();
+        maxSize = 0;
+        for (size_t h = 0; h < compactors.size(); ++h) maxSize += capacity(h);
+    }
+
+    void compress() {
+        for (size_t h = 0; h < compactors.size(); ++h) {
+            if (compactors[h].size() < capacity(h)) continue;
+            if (h + 1 == compactors.size()) grow();
+            std::vector<uint64_t>& level = compactors[h];
+            std::sort(level.begin(), level.end());
+            std::optional<uint64_t> leftover;
+            if (level.size() % 2) { leftover = level.back(); level.pop_back(); }
+            coin = mixHash64(coin);
+            for (size_t i = coin & 1; i < level.size(); i += 2) compactors[h + 1].push_back(level[i]);
+            level.clear();
+            if (leftover) level.push_back(*leftover);
+            size = 0;
+            for (const auto& c : compactors) size += c.size();
+            return;
+        }
+    }
+};
+
+// HyperLogLog distinct counter over 64-bit hashes: 2^14 one-byte registers (16 KB) for a standard
+// error of about 0.8%. Merging takes the register-wise maximum.
+class HyperLogLog {
+public:
+    static constexpr unsigned kPrecision = 14;
+    static constexpr size_t kRegisters = size_t(1) << kPrecision;
+
+    HyperLogLog() : registers(kRegisters) {}
+
+    void add(uint64_t hash) {
+        size_t index = static_cast<size_t>(hash >> (64 - kPrecision));
+        uint64_t rest = (hash << kPrecision) | (1ull << (kPrecision - 1)); // Sentinel bounds the rank
+        uint8_t rank = static_cast<uint8_t>(65 - bitWidth(rest));
+        if (rank > registers[index]) registers[index] = rank;
+    }
+
+    void merge(const HyperLogLog& other) {
+        for (size_t i = 0; i < kRegisters; ++i) registers[i] = std::max(registers[i], other.registers[i]);
+    }
+
+    // Raw estimate with linear counting for small cardinalities; 64-bit hashes need no large-range correction
+    uint64_t estimate() const {
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t r : registers) {
+            sum += std::ldexp(1.0, -r);
+            if (!r) ++zeros;
+        }
+        const double m = static_cast<double>(kRegisters);
+        double estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+        if (estimate <= 2.5 * m && zeros) estimate = m * std::log(m / zeros);
+        return static_cast<uint64_t>(estimate + 0.5);
+    }
+
+private:
+    std::vector<uint8_t> registers;
+};
+
+// Sink for --quantiles/--distinct: constant-memory sketches plus exact count/min/max, one per walker thread
+class SketchSink {
+public:
+    SketchSink(bool sizeQuantiles, std::optional<GroupField> distinctField) : sizeQuantiles(sizeQuantiles) {
+        if (distinctField) distinctKeys.emplace(*distinctField);
+    }
+
+    void onMatch(const WalkEntry& entry) {
+        uintmax_t size = fileSizeOf(entry.data);
+        totals.add(size, fileTimeTicks(entry.data.ftLastWriteTime));
+        if (sizeQuantiles) sizes.add(size);
+        if (distinctKeys) distinct.add(hash64(distinctKeys->of(entry)));
+    }
+
+    void merge(const SketchSink& other) {
+        totals.merge(other.totals);
+        sizes.merge(other.sizes);
+        distinct.merge(other.distinct);
+    }
+
+    AggregateStats totals;
+    KllSketch sizes;
+    HyperLogLog distinct;
+
+private:
+    bool sizeQuantiles;
+    std::optional<GroupKey> distinctKeys;
+};
+
+// Buffered sequential reads and writes over a Win32 file handle (used for --snapshot files)
+class BinaryFile {
+public:
+    BinaryFile() = default;
+    BinaryFile(const BinaryFile&) = delete;
+    BinaryFile& operator=(const BinaryFile&) = delete;
+    ~BinaryFile() { close(); }
+
+    bool open(const std::wstring& path, bool forWriting) {
+        close();
+        writing = forWriting;
+        handle = CreateFileW(path.c_str(), forWriting ? GENERIC_WRITE : GENERIC_READ, forWriting ? 0 : FILE_SHARE_READ,
+                             nullptr, forWriting ? CREATE_ALWAYS : OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        buffer.resize(kBufferSize);
+        begin = end = 0;
+        return handle != INVALID_HANDLE_VALUE;
+    }
+
+    bool write(const void* data, size_t length) {
+        const char* bytes = static_cast<const char*>(data);
+        while (length) {
+            if (end == buffer.size() && !flush()) return false;
+            size_t chunk = std::min(length, buffer.size() - end);
+            memcpy(buffer.data() + end, bytes, chunk);
+            end += chunk;
+            bytes += chunk;
+            length -= chunk;
+        }
+        return true;
+    }
+
+    bool read(void* data, size_t length) {
+        char* bytes = static_cast<char*>(data);
+        while (length) {
+            if (begin == end) {
+                DWORD got = 0;
+                if (!ReadFile(handle, buffer.data(), static_cast<DWORD>(buffer.size()), &got, nullptr) || !got) return false;
+                begin = 0;
+                end = got;
+            }
+            size_t chunk = std::min(length, end - begin);
+            memcpy(bytes, buffer.data() + begin, chunk);
+            begin += chunk;
+            bytes += chunk;
+            length -= chunk;
+        }
+        return true;
+    }
+
+    bool seek(uint64_t offset) {
+        if (writing && !flush()) return false;
+        begin = end = 0;
+        LARGE_INTEGER distance;
+        distance.QuadPart = static_cast<LONGLONG>(offset);
+        return SetFilePointerEx(handle, distance, nullptr, FILE_BEGIN) != 0;
+    }
+
+    bool flush() {
+        if (!writing || begin == end) return true;
+        DWORD written = 0;
+        bool ok = WriteFile(handle, buffer.data() + begin, static_cast<DWORD>(end - begin), &written, nullptr) && written == end - begin;
+        begin = end = 0;
+        return ok;
+    }
+
+    bool close() {
+        bool ok = true;
+        if (handle != INVALID_HANDLE_VALUE) {
+            ok = flush();
+            CloseHandle(handle);
+            handle = INVALID_HANDLE_VALUE;
+        }
+        return ok;
+    }
+
+private:
+    static constexpr size_t kBufferSize = 1 << 20;
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    bool writing = false;
+    std::vector<char> buffer;
+    size_t begin = 0, end = 0;
+};
+
+// --from-list: reads paths from a file or standard input ("-"), one per line or NUL-terminated (any NUL
+// in the first block read selects NUL-terminated). The input is UTF-8, or UTF-16LE when it starts with a
+// byte order mark. Entries are converted straight out of the read buffer into the caller's string; only
+// an entry cut off at the end of a block is moved. '/' is read as '\' and a trailing '\r' is dropped.
+class PathListReader {
+public:
+    PathListReader() = default;
+    PathListReader(const PathListReader&) = delete;
+    PathListReader& operator=(const PathListReader&) = delete;
+    ~PathListReader() {
+        if (ownsHandle && handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+    }
+
+    bool open(const std::wstring& source) {
+        ownsHandle = (source != L"-");
+        handle = ownsHandle ? CreateFileW(source.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                                          FILE_FLAG_SEQUENTIAL_SCAN, nullptr)
+                            : GetStdHandle(STD_INPUT_HANDLE);
+        if (!handle) handle = INVALID_HANDLE_VALUE;
+        buffer.resize(kBufferSize);
+        return handle != INVALID_HANDLE_VALUE;
+    }
+
+    // Next non-empty entry; false at the end of the list
+    bool next(std::wstring& path) {
+        for (;;) {
+            size_t unit = wide ? sizeof(char16_t) : 1;
+            size_t scanEnd = begin + (end - begin) / unit * unit;
+            size_t found = find(scanEnd);
+            if (found == scanEnd && !exhausted) {
+                fill();
+                continue;
+            }
+            convert(begin, found, path);
+            begin = std::min(found + unit, end);
+            if (!path.empty()) return true;
+            if (found == scanEnd && exhausted) return false;
+        }
+    }
+
+private:
+    static constexpr size_t kBufferSize = 1 << 20;
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    bool ownsHandle = false;
+    std::vector<char> buffer;
+    size_t begin = 0, end = 0;
+    bool started = false, exhausted = false;
+    bool wide = false, nulTerminated = false;
+
+    // Position of the next delimiter in [begin, scanEnd), or scanEnd
+    size_t find(size_t scanEnd) const {
+        if (wide) {
+            const char16_t* first = reinterpret_cast<const char16_t*>(buffer.data() + begin);
+            const char16_t* last = reinterpret_cast<const char16_t*>(buffer.data() + scanEnd);
+            const char16_t* hit = std::find(first, last, nulTerminated ? u'\0' : u'\n');
+            return begin + (hit - first) * sizeof(char16_t);
+        }
+        const void* hit = memchr(buffer.data() + begin, nulTerminated ? '\0' : '\n', scanEnd - begin);
+        return hit ? static_cast<const char*>(hit) - buffer.data() : scanEnd;
+    }
+
+    void fill() {
+        if (begin > 0) {
+            memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        if (end == buffer.size()) buffer.resize(buffer.size() * 2); // One entry longer than the buffer
+        DWORD got = 0;
+        if (!ReadFile(handle, buffer.data() + end, static_cast<DWORD>(buffer.size() - end), &got, nullptr) || !got) {
+            exhausted = true;
+            return;
+        }
+        end += got;
+        if (!started) {
+            started = true;
+            if (end >= 2 && static_cast<unsigned char>(buffer[0]) == 0xFF && static_cast<unsigned char>(buffer[1]) == 0xFE) {
+                wide = true;
+                begin = 2;
+            } else if (end >= 3 && memcmp(buffer.data(), "\xEF\xBB\xBF", 3) == 0) {
+                begin = 3;
+            }
+            if (wide) {
+                const char16_t* first = reinterpret_cast<const char16_t*>(buffer.data() + begin);
+                const char16_t* last = first + (end - begin) / sizeof(char16_t);
+                nulTerminated = std::find(first, last, u'\0') != last;
+            } else {
+                nulTerminated = memchr(buffer.data() + begin, '\0', end - begin) != nullptr;
+            }
+        }
+    }
+
+    void convert(size_t from, size_t to, std::wstring& path) const {
+        if (wide) {
+            const char16_t* units = reinterpret_cast<const char16_t*>(buffer.data() + from);
+            path.assign(units, units + (to - from) / sizeof(char16_t));
+        } else {
+            const char* bytes = buffer.data() + from;
+            int length = static_cast<int>(to - from);
+            bool ascii = std::all_of(bytes, bytes + length, [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+            if (ascii) {
+                path.assign(bytes, bytes + length);
+            } else {
+                path.resize(MultiByteToWideChar(CP_UTF8, 0, bytes, length, nullptr, 0));
+                if (!path.empty()) MultiByteToWideChar(CP_UTF8, 0, bytes, length, &path[0], static_cast<int>(path.size()));
+            }
+        }
+        if (!nulTerminated && !path.empty() && path.back() == L'\r') path.pop_back();
+        std::replace(path.begin(), path.end(), L'/', L'\\');
+    }
+};
+
+// --snapshot file layout: a SnapshotHeader, the matched paths as one UTF-16 blob in walk order, then
+// one SnapshotRecord per file sorted by path hash. A diff streams the previous snapshot's records in
+// order against the current run's sorted records, so only the current records are held in memory.
+struct SnapshotHeader {
+    char magic[8];
+    uint64_t scope;        // Hash of the searched directory and pattern
+    uint64_t recordCount;
+    uint64_t recordsOffset;
+};
+
+struct SnapshotRecord {
+    uint64_t hash;
+    uint64_t size;
+    uint64_t modified;     // FILETIME ticks
+    uint64_t pathRef;      // Blob offset in characters << 16 | path length
+
+    size_t pathLength() const { return static_cast<size_t>(pathRef & 0xffff); }
+    uint64_t pathOffset() const { return pathRef >> 16; }
+};
+
+static const char kSnapshotMagic[8] = {'F', 'F', 'S', 'N', 'A', 'P', '1', '\0'};
+
+struct SnapshotChange {
+    wchar_t tag;           // 'A'dded, 'R'emoved, 'M'odified
+    SnapshotRecord record; // Current record, or the previous one for removals
+    std::wstring path;
+};
+
+// Sink for --snapshot: streams each matched path into the new snapshot's blob and keeps a 32-byte record
+class SnapshotSink {
+public:
+    explicit SnapshotSink(BinaryFile& blob) : blob(blob) {}
+
+    void onMatch(const WalkEntry& entry) {
+        const std::wstring& path = entry.fullPath();
+        size_t length = std::min<size_t>(path.length(), 0xffff);
+        records.push_back({hash64(path), fileSizeOf(entry.data), fileTimeTicks(entry.data.ftLastWriteTime), (blobLength << 16) | length});
+        ok = blob.write(path.data(), length * sizeof(wchar_t)) && ok;
+        blobLength += length;
+    }
+
+    std::vector<SnapshotRecord> records;
+    bool ok = true;
+
+private:
+    BinaryFile& blob;
+    uint64_t blobLength = 0;
+};
+
+class Snapshot {
+public:
+    // Completes a snapshot whose header space and path blob `file` already holds: sorts the records,
+    // appends them and fills in the header
+    static bool finish(BinaryFile& file, std::vector<SnapshotRecord>& records, uint64_t scope, uint64_t blobLength) {
+        std::sort(records.begin(), records.end(), [](const SnapshotRecord& a, const SnapshotRecord& b) {
+            return a.hash != b.hash ? a.hash < b.hash : a.pathRef < b.pathRef;
+        });
+        SnapshotHeader header;
+        memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+        header.scope = scope;
+        header.recordCount = records.size();
+        header.recordsOffset = sizeof(SnapshotHeader) + blobLength * sizeof(wchar_t);
+        return file.write(records.data(), records.size() * sizeof(SnapshotRecord))
+            && file.seek(0) && file.write(&header, sizeof(header)) && file.close();
+    }
+
+    static bool readHeader(BinaryFile& file, SnapshotHeader& header) {
+        return file.read(&header, sizeof(header)) && memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) == 0;
+    }
+
+    // Merges the previous snapshot's records (read sequentially from `previous`, if any) with the current
+    // sorted records; paths are left empty and filled in by resolvePaths
+    static std::vector<SnapshotChange> diff(BinaryFile* previous, const SnapshotHeader& previousHeader,
+                                            const std::vector<SnapshotRecord>& current) {
+        std::vector<SnapshotChange> changes;
+        uint64_t remaining = previous ? previousHeader.recordCount : 0;
+        SnapshotRecord old{};
+        bool haveOld = remaining && previous->seek(previousHeader.recordsOffset) && previous->read(&old, sizeof(old));
+        size_t i = 0;
+        while (haveOld || i < current.size()) {
+            if (!haveOld || (i < current.size() && current[i].hash < old.hash)) {
+                changes.push_back({L'A', current[i++], {}});
+                continue;
+            }
+            if (i == current.size() || old.hash < current[i].hash) {
+                changes.push_back({L'R', old, {}});
+            } else {
+                if (current[i].size != old.size || current[i].modified != old.modified) changes.push_back({L'M', current[i], {}});
+                ++i;
+            }
+            haveOld = --remaining && previous->read(&old, sizeof(old));
+        }
+        return changes;
+    }
+
+    // Reads the path of every change from the snapshot it came from, in blob order
+    static void resolvePaths(std::vector<SnapshotChange>& changes, BinaryFile* previous, BinaryFile& current) {
+        std::vector<SnapshotChange*> ordered;
+        for (auto& change : changes) ordered.push_back(&change);
+        std::sort(ordered.begin(), ordered.end(), [](const SnapshotChange* a, const SnapshotChange* b) {
+            return (a->tag == L'R') != (b->tag == L'R') ? a->tag != L'R' : a->record.pathRef < b->record.pathRef;
+        });
+        for (SnapshotChange* change : ordered) {
+            BinaryFile* file = (change->tag == L'R') ? previous : &current;
+            change->path.resize(change->record.pathLength());
+            if (!file->seek(sizeof(SnapshotHeader) + change->record.pathOffset() * sizeof(wchar_t))
+                || !file->read(&change->path[0], change->path.length() * sizeof(wchar_t))) {
+                change->path = L"(unreadable snapshot path)";
+            }
+        }
+    }
+};
+
+// Sink for --per-dir-top/--per-dir-rest: per directory, keeps the first N matches in --sort order in
+// a bounded heap (worst kept match on top) and hands that directory's selection to `results` once its
+// enumeration finishes. Only directories still being enumerated hold state, and no global sort is needed.
+class PerDirectorySink {
+public:
+    PerDirectorySink(std::vector<FileInfo>& results, std::vector<SortOption> sortOptions, size_t limit, bool keepTop)
+        : results(results), sortOptions(std::move(sortOptions)), limit(limit), keepTop(keepTop) {}
+
+    void onMatch(const WalkEntry& entry) {
+        Selection& selection = slot(entry.directory);
+        FileInfo info = makeFileInfo(entry.fullPath(), entry.data);
+        auto less = [this](const FileInfo& a, const FileInfo& b) { return fileInfoLess(a, b, sortOptions); };
+        if (selection.kept.size() < limit) {
+            selection.kept.push_back(std::move(info));
+            std::push_heap(selection.kept.begin(), selection.kept.end(), less);
+        } else if (limit && less(info, selection.kept.front())) {
+            std::pop_heap(selection.kept.begin(), selection.kept.end(), less);
+            if (!keepTop) selection.rest.push_back(std::move(selection.kept.back()));
+            selection.kept.back() = std::move(info);
+            std::push_heap(selection.kept.begin(), selection.kept.end(), less);
+        } else if (!keepTop) {
+            selection.rest.push_back(std::move(info));
+        }
+    }
+
+    void onDirectoryEnd(const std::wstring& directory) {
+        auto it = pending.find(directory);
+        if (it == pending.end()) return;
+        std::vector<FileInfo>& selected = keepTop ? it->second.kept : it->second.rest;
+        std::sort(selected.begin(), selected.end(), [this](const FileInfo& a, const FileInfo& b) { return fileInfoLess(a, b, sortOptions); });
+        results.insert(results.end(), std::make_move_iterator(selected.begin()), std::make_move_iterator(selected.end()));
+        pending.erase(it);
+        currentKey = nullptr;
+        current = nullptr;
+    }
+
+private:
+    struct Selection {
+        std::vector<FileInfo> kept; // Heap of the best `limit` matches so far
+        std::vector<FileInfo> rest; // Everything else (only collected for --per-dir-rest)
+    };
+
+    std::vector<FileInfo>& results;
+    std::vector<SortOption> sortOptions;
+    size_t limit;
+    bool keepTop;
+    std::unordered_map<std::wstring, Selection> pending;
+    const std::wstring* currentKey = nullptr;
+    Selection* current = nullptr;
+
+    Selection& slot(const std::wstring& directory) {
+        if (!current || directory != *currentKey) {
+            auto it = pending.try_emplace(directory).first;
+            currentKey = &it->first;
+            current = &it->second;
+        }
+        return *current;
+    }
+};
+
+// --dedup-links: remembers every matched file that has more than one hard link by its exact
+// (volume serial, 128-bit file ID) pair in an open-addressing table, so a file reachable under several
+// names is passed on once. The 128-bit ID is used because the older 64-bit file index is not unique on
+// ReFS. Files with a single link are never stored. Enumeration data carries no link count on Windows,
+// so each matched file is opened once for its file information.
+class HardLinkSet {
+public:
+    // False when another name of the same file was already seen
+    bool firstSighting(const std::wstring& path) {
+        HANDLE file = CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return true;
+        BY_HANDLE_FILE_INFORMATION info;
+        FILE_ID_INFO id;
+        BOOL ok = GetFileInformationByHandle(file, &info) && info.nNumberOfLinks > 1 &&
+                  GetFileInformationByHandleEx(file, FileIdInfo, &id, sizeof(id));
+        CloseHandle(file);
+        if (!ok) return true;
+
+        Identity key;
+        key.volume = id.VolumeSerialNumber;
+        memcpy(key.file, id.FileId.Identifier, sizeof(key.file));
+        std::lock_guard<std::mutex> lock(mutex);
+        return insert(key);
+    }
+
+private:
+    struct Identity {
+        uint64_t volume = 0;
+        uint64_t file[2] = {0, 0};
+        bool occupied = false;
+
+        bool operator==(const Identity& other) const {
+            return volume == other.volume && file[0] == other.file[0] && file[1] == other.file[1];
+        }
+        size_t hash() const { return static_cast<size_t>(mixHash64(file[0] ^ mixHash64(file[1] ^ mixHash64(volume)))); }
+    };
+
+    std::vector<Identity> slots;
+    size_t used = 0;
+    std::mutex mutex;
+
+    bool insert(Identity key) {
+        if ((used + 1) * 4 > slots.size() * 3) grow(); // Load factor at most 3/4
+        size_t mask = slots.size() - 1;
+        for (size_t i = key.hash() & mask;; i = (i + 1) & mask) {
+            if (!slots[i].occupied) {
+                key.occupied = true;
+                slots[i] = key;
+                ++used;
+                return true;
+            }
+            if (slots[i] == key) return false;
+        }
+    }
+
+    void grow() {
+        std::vector<Identity> old(slots.empty() ? 1024 : slots.size() * 2);
+        old.swap(slots);
+        used = 0;
+        for (const Identity& key : old) {
+            if (key.occupied) insert(key);
+        }
+    }
+};
+
+// Sinks that define onDirectoryEnd(directory) are told when a directory's own entries are exhausted
+template <class Sink, class = void>
+struct WantsDirectoryEnd : std::false_type {};
+
+template <class Sink>
+struct WantsDirectoryEnd<Sink, std::void_t<decltype(std::declval<Sink&>().onDirectoryEnd(std::declval<const std::wstring&>()))>> : std::true_type {};
+
+// Sinks that define merge(other) can be split per walker thread and combined afterwards
+template <class Sink, class = void>
+struct Mergeable : std::false_type {};
+
+template <class Sink>
+struct Mergeable<Sink, std::void_t<decltype(std::declval<Sink&>().merge(std::declval<Sink&&>()))>> : std::true_type {};
+
+// Share of the machine this process may use. hardware_concurrency() counts every processor, so a
+// process confined by an affinity mask or a job object's CPU rate cap would oversubscribe what it has.
+struct ResourceBudget {
+    size_t processors = 1;
+    size_t machineProcessors = 1;
+    uint64_t memory = 0;        // Bytes: physical memory, or the job's memory limit when lower
+    bool memoryLimited = false; // The job object sets that limit
+};
+
+// The processor group the process runs in, or nullopt when its threads already span several. Before
+// Windows 11 a process starts in one group, and the affinity masks of GetProcessAffinityMask describe
+// only that group.
+std::optional<USHORT> processGroup() {
+    USHORT count = 0;
+    std::vector<USHORT> groups;
+    while (!GetProcessGroupAffinity(GetCurrentProcess(), &count, groups.data())) {
+        if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) return std::nullopt;
+        groups.resize(count);
+    }
+    if (count != 1) return std::nullopt;
+    return groups[0];
+}
+
+ResourceBudget detectResourceBudget() {
+    ResourceBudget budget;
+    budget.machineProcessors = std::max<size_t>(1, GetActiveProcessorCount(ALL_PROCESSOR_GROUPS));
+    budget.processors = budget.machineProcessors;
+
+    // A process in a single group only gets that group's processors (a machine with more than 64 has
+    // several groups), and an affinity mask narrower than the system's (set by start /affinity or a
+    // job's affinity limit) trims them further
+    std::optional<USHORT> group = processGroup();
+    if (group) budget.processors = std::clamp<size_t>(GetActiveProcessorCount(*group), 1, budget.processors);
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if (group && GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) && processMask && processMask != systemMask) {
+        size_t allowed = 0;
+        for (DWORD_PTR mask = processMask; mask; mask &= mask - 1) ++allowed;
+        budget.processors = std::min(budget.processors, allowed);
+    }
+
+    // A hard CPU rate cap is a share of the whole machine, in hundredths of a percent
+    JOBOBJECT_CPU_RATE_CONTROL_INFORMATION rate = {};
+    if (QueryInformationJobObject(NULL, JobObjectCpuRateControlInformation, &rate, sizeof(rate), NULL) &&
+        (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_ENABLE)) {
+        DWORD cap = 0;
+        if (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP) cap = rate.CpuRate;
+        else if (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_MIN_MAX_RATE) cap = rate.MaxRate;
+        if (cap) {
+            size_t capped = (static_cast<uint64_t>(cap) * budget.machineProcessors + 9999) / 10000;
+            budget.processors = std::clamp<size_t>(capped, 1, budget.processors);
+        }
+    }
+
+    MEMORYSTATUSEX memoryStatus = {};
+    memoryStatus.dwLength = sizeof(memoryStatus);
+    if (GlobalMemoryStatusEx(&memoryStatus)) budget.memory = memoryStatus.ullTotalPhys;
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+    if (QueryInformationJobObject(NULL, JobObjectExtendedLimitInformation, &limits, sizeof(limits), NULL)) {
+        DWORD flags = limits.BasicLimitInformation.LimitFlags;
+        for (uint64_t limit : { (flags & JOB_OBJECT_LIMIT_PROCESS_MEMORY) ? uint64_t(limits.ProcessMemoryLimit) : 0,
+                                (flags & JOB_OBJECT_LIMIT_JOB_MEMORY) ? uint64_t(limits.JobMemoryLimit) : 0 }) {
+            if (limit && (!budget.memory || limit < budget.memory)) {
+                budget.memory = limit;
+                budget.memoryLimited = true;
+            }
+        }
+    }
+    return budget;
+}
+
+// NUMA nodes of the machine with the processors of each this process may use. A machine without NUMA,
+// or a process confined to one node, has a single node and no thread is pinned.
+struct NumaTopology {
+    struct Node {
+        USHORT number;
+        GROUP_AFFINITY processors;
+    };
+    std::vector<Node> nodes;
+
+    bool multiNode() const { return nodes.size() > 1; }
+
+    static const NumaTopology& get() {
+        static const NumaTopology topology = detect();
+        return topology;
+    }
+
+private:
+    static NumaTopology detect() {
+        NumaTopology topology;
+        ULONG highest = 0;
+        if (!GetNumaHighestNodeNumber(&highest) || highest == 0) return topology;
+        // The process affinity mask only describes the process's own group
+        std::optional<USHORT> group = processGroup();
+        DWORD_PTR processMask = 0, systemMask = 0;
+        bool confined = group && GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) && processMask && processMask != systemMask;
+        for (ULONG number = 0; number <= highest; ++number) {
+            Node node{ static_cast<USHORT>(number), {} };
+            if (!GetNumaNodeProcessorMaskEx(node.number, &node.processors)) continue;
+            if (confined && node.processors.Group == *group) node.processors.Mask &= processMask;
+            if (node.processors.Mask) topology.nodes.push_back(node);
+        }
+        return topology;
+    }
+};
+
+// Fixed set of threads running queued tasks. Tasks may submit further tasks; wait() returns once the
+// queue is empty and no task is running. The queue is LIFO so a recursive walk stays depth-first and
+// the number of queued directories stays small.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threadCount) {
+        for (size_t i = 0; i < std::max<size_t>(1, threadCount); ++i) threads.emplace_back([this, i] { run(i); });
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+        for (auto& thread : threads) thread.join();
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+            ++pending;
+        }
+        available.notify_one();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return pending == 0; });
+    }
+
+    size_t size() const { return threads.size(); }
+
+    // Lets at most `limit` threads (at least one) run tasks at once; the others wait
+    void setActiveLimit(size_t limit) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            activeLimit = std::max<size_t>(1, limit);
+        }
+        available.notify_all();
+    }
+
+    // Index of the pool thread running the caller, for per-worker state (0 outside a pool)
+    static size_t currentWorker() { return workerIndex; }
+
+    // NUMA node (index into NumaTopology::nodes) a pool thread is pinned to; consecutive threads go
+    // to different nodes
+    static size_t nodeOf(size_t worker) {
+        const NumaTopology& numa = NumaTopology::get();
+        return numa.multiNode() ? worker % numa.nodes.size() : 0;
+    }
+
+private:
+    static inline thread_local size_t workerIndex = 0;
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable available, idle;
+    size_t pending = 0;
+    size_t running = 0;
+    size_t activeLimit = SIZE_MAX;
+    bool stopping = false;
+
+    void run(size_t index) {
+        workerIndex = index;
+        const NumaTopology& numa = NumaTopology::get();
+        if (numa.multiNode()) SetThreadGroupAffinity(GetCurrentThread(), &numa.nodes[nodeOf(index)].processors, NULL);
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [this] { return stopping || (!tasks.empty() && running < activeLimit); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.back());
+                tasks.pop_back();
+                ++running;
+            }
+            task();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --running;
+                if (--pending == 0) idle.notify_all();
+            }
+            available.notify_one(); // A slot under the active limit is free again
+        }
+    }
+};
+
+// Tunes how many pool threads a parallel walk keeps busy, AIMD style. Every window of completed
+// directories it compares directories/sec and the mean time to list one directory with the window
+// before: while throughput improves, or latency stays near the best seen, one more thread is let in;
+// when throughput falls by a tenth or latency grows fourfold (a disk queueing requests), a quarter of
+// the threads are parked. Fast SSDs climb to many threads, spinning disks settle at a few, and network
+// shares, where latency hides behind concurrency, go up to the pool size.
+class ConcurrencyController {
+public:
+    ConcurrencyController(WorkerPool& pool, size_t initial) : pool(pool), limit(std::min(initial, pool.size())), peak(limit) {
+        limitSnapshot.store(limit, std::memory_order_relaxed);
+        pool.setActiveLimit(limit);
+    }
+
+    // Called by a worker after listing one directory
+    void record(std::chrono::steady_clock::duration latency) {
+        uint64_t done = completed.fetch_add(1, std::memory_order_relaxed) + 1;
+        latencyTotal.fetch_add(static_cast<uint64_t>(latency.count()), std::memory_order_relaxed);
+        if (done < std::max<uint64_t>(32, limitSnapshot.load(std::memory_order_relaxed) * 8)) return;
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock) return;
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = now - windowStart;
+        if (elapsed < std::chrono::milliseconds(50)) return;
+        uint64_t directories = completed.exchange(0, std::memory_order_relaxed);
+        uint64_t latencySum = latencyTotal.exchange(0, std::memory_order_relaxed);
+        windowStart = now;
+        if (directories) adjust(directories / elapsed.count(), static_cast<double>(latencySum) / directories);
+    }
+
+    size_t current() const { return limit; }
+    size_t peakLimit() const { return peak; }
+    size_t adjustments() const { return changes; }
+
+private:
+    WorkerPool& pool;
+    std::mutex mutex;
+    std::atomic<uint64_t> completed{0}, latencyTotal{0};
+    std::atomic<size_t> limitSnapshot{0};
+    std::chrono::steady_clock::time_point windowStart = std::chrono::steady_clock::now();
+    size_t limit, peak;
+    size_t changes = 0;
+    double previousRate = 0;
+    double bestLatency = 0;
+
+    void adjust(double rate, double latency) {
+        bestLatency = bestLatency ? std::min(bestLatency, latency) : latency;
+        size_t next = limit;
+        if (previousRate && (rate < previousRate * 0.9 || latency > bestLatency * 4)) {
+            next = limit - std::max<size_t>(1, limit / 4);
+        } else if (!previousRate || rate > previousRate * 1.02 || latency < bestLatency * 2) {
+            next = limit + 1;
+        }
+        next = std::clamp<size_t>(next, 1, pool.size());
+        previousRate = rate;
+        if (next == limit) return;
+        limit = next;
+        peak = std::max(peak, limit);
+        ++changes;
+        limitSnapshot.store(limit, std::memory_order_relaxed);
+        pool.setActiveLimit(limit);
+    }
+};
+
+// --pace: hands out evenly spaced time slots, `rate` per second, to every thread that calls wait().
+// Idle time earns no credit, so a paused walk does not come back with a burst.
+class Pacer {
+public:
+    explicit Pacer(double rate)
+        : interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate))) {}
+
+    void wait() {
+        std::chrono::steady_clock::time_point slot;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            next = std::max(next, std::chrono::steady_clock::now());
+            slot = next;
+            next += interval;
+        }
+        std::this_thread::sleep_until(slot);
+    }
+
+private:
+    std::mutex mutex;
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::time_point next;
+};
+
+// --diff: walks two trees in lockstep. Each directory pair is listed, both listings are sorted by
+// name (case-insensitive, as NTFS compares names) and merged; subdirectories present on both sides
+// become new pool tasks, so independent subtrees are compared in parallel.
+class TreeDiff {
+public:
+    struct Difference {
+        wchar_t tag;            // '-' only in the first tree, '+' only in the second, 'S' size, 'T' time, 'C' content
+        std::wstring path;      // Relative to the roots; directories end in '\'
+        uintmax_t leftSize, rightSize;
+        ULONGLONG leftModified, rightModified;
+    };
+
+    // With `shallow`, only the roots' own entries are compared; subdirectories are not descended into
+    TreeDiff(const PatternMatcher& matcher, bool compareContent, bool shallow)
+        : matcher(matcher), compareContent(compareContent), shallow(shallow) {}
+
+    std::vector<Difference> run(const std::wstring& left, const std::wstring& right, WorkerPool& pool) {
+        pool.submit([this, &pool, left, right] { compareDirectory(left, right, L"", pool); });
+        pool.wait();
+        std::sort(differences.begin(), differences.end(), [](const Difference& a, const Difference& b) {
+            return CompareStringOrdinal(a.path.c_str(), -1, b.path.c_str(), -1, TRUE) == CSTR_LESS_THAN;
+        });
+        return std::move(differences);
+    }
+
+    std::atomic<uint64_t> directories{0}, files{0};
+
+private:
+    struct Listing {
+        std::wstring name;
+        bool directory;
+        uintmax_t size;
+        ULONGLONG modified;
+    };
+
+    const PatternMatcher& matcher;
+    bool compareContent;
+    bool shallow;
+    std::mutex resultsMutex;
+    std::vector<Difference> differences;
+
+    static std::wstring join(const std::wstring& directory, const std::wstring& name) {
+        return (!directory.empty() && directory.back() != L'\\') ? directory + L'\\' + name : directory + name;
+    }
+
+    static bool nameLess(const Listing& a, const Listing& b) {
+        return CompareStringOrdinal(a.name.c_str(), -1, b.name.c_str(), -1, TRUE) == CSTR_LESS_THAN;
+    }
+
+    // Directories plus the files whose names match the pattern, sorted by name
+    std::optional<std::vector<Listing>> list(const std::wstring& directory) {
+        WIN32_FIND_DATAW findData;
+        HANDLE hFind = FindFirstFileW(join(directory, L"*").c_str(), &findData);
+        if (hFind == INVALID_HANDLE_VALUE) {
+            DWORD error = GetLastError();
+            if (error == ERROR_FILE_NOT_FOUND) return std::vector<Listing>();
+            std::wcerr << L"Error searching directory: " << error << L" Directory: " << directory << std::endl;
+            return std::nullopt;
+        }
+        std::vector<Listing> entries;
+        SearchStats unused;
+        do {
+            if (wcscmp(findData.cFileName, L".") == 0 || wcscmp(findData.cFileName, L"..") == 0) continue;
+            bool isDirectory = (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+            if (!isDirectory && !matcher.matches(findData.cFileName, unused)) continue;
+            entries.push_back({findData.cFileName, isDirectory, fileSizeOf(findData), fileTimeTicks(findData.ftLastWriteTime)});
+        } while (FindNextFileW(hFind, &findData));
+        FindClose(hFind);
+        std::sort(entries.begin(), entries.end(), nameLess);
+        return entries;
+    }
+
+    // Whether a directory present on one side only holds any matching file, at any depth. Stops at
+    // the first one, so a one-sided directory is only walked in full when nothing in it matches.
+    bool containsMatch(const std::wstring& directory) {
+        WIN32_FIND_DATAW findData;
+        HANDLE hFind = FindFirstFileW(join(directory, L"*").c_str(), &findData);
+        if (hFind == INVALID_HANDLE_VALUE) return false;
+        bool found = false;
+        SearchStats unused;
+        do {
+            if (wcscmp(findData.cFileName, L".") == 0 || wcscmp(findData.cFileName, L"..") == 0) continue;
+            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                found = containsMatch(join(directory, findData.cFileName));
+            } else {
+                found = matcher.matches(findData.cFileName, unused);
+            }
+        } while (!found && FindNextFileW(hFind, &findData));
+        FindClose(hFind);
+        return found;
+    }
+
+    void compareDirectory(const std::wstring& left, const std::wstring& right, const std::wstring& relative, WorkerPool& pool) {
+        auto leftEntries = list(left);
+        auto rightEntries = list(right);
+        if (!leftEntries || !rightEntries) return;
+        ++directories;
+
+        // A directory on one side only is reported when it holds a matching file
+        std::vector<Difference> found;
+        auto only = [this, &found, &relative, &left, &right](wchar_t tag, const Listing& entry) {
+            if (entry.directory && !containsMatch(join(tag == L'-' ? left : right, entry.name))) return;
+            std::wstring path = relative + entry.name + (entry.directory ? L"\\" : L"");
+            uintmax_t size = entry.directory ? 0 : entry.size;
+            if (tag == L'-') found.push_back({tag, path, size, 0, entry.modified, 0});
+            else found.push_back({tag, path, 0, size, 0, entry.modified});
+        };
+        size_t i = 0, j = 0;
+        while (i < leftEntries->size() || j < rightEntries->size()) {
+            if (j == rightEntries->size() || (i < leftEntries->size() && nameLess((*leftEntries)[i], (*rightEntries)[j]))) {
+                only(L'-', (*leftEntries)[i++]);
+                continue;
+            }
+            if (i == leftEntries->size() || nameLess((*rightEntries)[j], (*leftEntries)[i])) {
+                only(L'+', (*rightEntries)[j++]);
+                continue;
+            }
+            const Listing& a = (*leftEntries)[i++];
+            const Listing& b = (*rightEntries)[j++];
+            if (a.directory != b.directory) {
+                only(L'-', a);
+                only(L'+', b);
+            } else if (a.directory) {
+                if (shallow) continue;
+                std::wstring leftChild = join(left, a.name), rightChild = join(right, b.name), relativeChild = relative + a.name + L'\\';
+                pool.submit([this, &pool, leftChild, rightChild, relativeChild] { compareDirectory(leftChild, rightChild, relativeChild, pool); });
+            } else {
+                ++files;
+                wchar_t tag = 0;
+                if (a.size != b.size) tag = L'S';
+                else if (compareContent && !sameContent(join(left, a.name), join(right, b.name))) tag = L'C';
+                else if (a.modified != b.modified) tag = L'T';
+                if (tag) found.push_back({tag, relative + a.name, a.size, b.size, a.modified, b.modified});
+            }
+        }
+        if (!found.empty()) {
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            differences.insert(differences.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+        }
+    }
+
+    // Byte-for-byte comparison of two files already known to have the same size
+    static bool sameContent(const std::wstring& leftPath, const std::wstring& rightPath) {
+        const DWORD chunk = 256 * 1024;
+        thread_local std::vector<char> leftBuffer(chunk), rightBuffer(chunk);
+        HANDLE leftFile = CreateFileW(leftPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        HANDLE rightFile = CreateFileW(rightPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        bool same = leftFile != INVALID_HANDLE_VALUE && rightFile != INVALID_HANDLE_VALUE;
+        while (same) {
+            DWORD leftRead = 0, rightRead = 0;
+            if (!ReadFile(leftFile, leftBuffer.data(), chunk, &leftRead, nullptr) || !ReadFile(rightFile, rightBuffer.data(), chunk, &rightRead, nullptr)) {
+                same = false;
+                break;
+            }
+            if (leftRead != rightRead || memcmp(leftBuffer.data(), rightBuffer.data(), leftRead) != 0) same = false;
+            if (!leftRead) break;
+        }
+        if (leftFile != INVALID_HANDLE_VALUE) CloseHandle(leftFile);
+        if (rightFile != INVALID_HANDLE_VALUE) CloseHandle(rightFile);
+        return same;
+    }
+};
+
+class FileFinder {
+public:
+    static std::vector<FileInfo> findFiles(
+        const std::vector<std::wstring>& roots,
+        const std::wstring& pattern,
+        const SearchOptions& options,
+        SearchStats* stats = nullptr) {
+        CollectSink sink;
+        SearchStats searchStats = search(roots, pattern, options, sink);
+        if (stats) *stats = searchStats;
+        return std::move(sink.results);
+    }
+
+    // Walks the trees under `roots` (which must not overlap) feeding every match to the sink. The
+    // per-entry loop is instantiated for the requested feature set and selected once here, so it
+    // carries no per-entry option checks. With several threads and a sink that can merge, every
+    // directory becomes a task on one shared pool and each worker fills its own copy of the sink.
+    template <class Sink>
+    static SearchStats search(
+        const std::vector<std::wstring>& roots,
+        const std::wstring& pattern,
+        const SearchOptions& options,
+        Sink& sink) {
+        if (options.debug) {
+            std::wcout << L"Pattern: " << pattern << std::endl;
+        }
+
+        SearchStats stats;
+        std::optional<PatternMatcher> matcher;
+        try {
+            matcher.emplace(pattern, options.excludes, options.useRegex, options.pathMatch);
+        } catch (const std::regex_error& e) {
+            std::string what_str = e.what();
+            std::wcerr << L"Invalid regex pattern: " << std::wstring(what_str.begin(), what_str.end()) << std::endl;
+            return stats;
+        }
+
+        std::optional<HardLinkSet> links;
+        if (options.dedupLinks) links.emplace();
+        std::optional<Pacer> pacer;
+        if (options.pace > 0) pacer.emplace(options.pace);
+        if constexpr (Mergeable<Sink>::value) {
+            if (options.threads > 1 && !options.pathOrder) {
+                return searchParallel(roots, *matcher, options, links ? &*links : nullptr, pacer ? &*pacer : nullptr, sink);
+            }
+        }
+
+        // Separate roots come out in path order when their keys (root + '\') are sorted like names
+        std::vector<std::wstring> ordered = roots;
+        if (options.pathOrder) {
+            auto key = [](const std::wstring& root) { return (!root.empty() && root.back() == L'\\') ? root : root + L'\\'; };
+            std::sort(ordered.begin(), ordered.end(), [&](const std::wstring& a, const std::wstring& b) {
+                return options.pathOrder > 0 ? key(a) < key(b) : key(b) < key(a);
+            });
+        }
+        ScanContext context{ *matcher, options, stats, links ? &*links : nullptr, pacer ? &*pacer : nullptr };
+        ScanKernel<Sink> kernel = selectKernel<Sink>(options);
+        for (const auto& root : ordered) kernel(root, context, sink);
+        return stats;
+    }
+
+    // --from-list (and --follow): runs the paths `list.next(path)` yields through the filter, pattern and
+    // sink in list order instead of walking directories. Paths are looked up a batch at a time spread over a
+    // pool of `options.threads`: sizes and times only when `needMetadata` says something uses them,
+    // otherwise just the attributes. Listed directories and paths that no longer exist are skipped.
+    template <class Source, class Sink>
+    static SearchStats searchList(
+        Source& list,
+        const std::wstring& pattern,
+        const SearchOptions& options,
+        bool needMetadata,
+        Sink& sink) {
+        if (options.debug) {
+            std::wcout << L"Pattern: " << pattern << std::endl;
+        }
+
+        SearchStats stats;
+        std::optional<PatternMatcher> matcher;
+        try {
+            matcher.emplace(pattern, options.excludes, options.useRegex, options.pathMatch);
+        } catch (const std::regex_error& e) {
+            std::string what_str = e.what();
+            std::wcerr << L"Invalid regex pattern: " << std::wstring(what_str.begin(), what_str.end()) << std::endl;
+            return stats;
+        }
+
+        std::optional<HardLinkSet> links;
+        if (options.dedupLinks) links.emplace();
+        std::optional<Pacer> pacer;
+        if (options.pace > 0) pacer.emplace(options.pace);
+        ScanContext context{ *matcher, options, stats, links ? &*links : nullptr, pacer ? &*pacer : nullptr };
+        // Indexed by [pathMatch][filtered]
+        static const ListKernel<Source, Sink> kernels[2][2] = {
+            { scanList<false, false, Source, Sink>, scanList<false, true, Source, Sink> },
+            { scanList<true, false, Source, Sink>, scanList<true, true, Source, Sink> }
+        };
+        kernels[options.pathMatch][options.filter.active()](list, context, sink, needMetadata);
+        return stats;
+    }
+
+private:
+    struct ScanContext {
+        const PatternMatcher& matcher;
+        const SearchOptions& options;
+        SearchStats& stats;
+        HardLinkSet* links; // Only with --dedup-links
+        Pacer* pacer; // Only with --pace
+    };
+
+    // Per-thread state of a parallel walk, padded to its own cache lines
+    template <class Sink>
+    struct alignas(64) WorkerState {
+        SearchStats stats;
+        Sink sink;
+    };
+
+    template <class Sink>
+    struct ParallelScan {
+        const PatternMatcher& matcher;
+        const SearchOptions& options;
+        HardLinkSet* links;
+        Pacer* pacer;
+        WorkerPool& pool;
+        std::vector<WorkerState<Sink>>& workers;
+        ConcurrencyController* controller;
+    };
+
+    template <class Sink>
+    using ParallelKernel = void (*)(const std::wstring&, ParallelScan<Sink>&);
+
+    template <class Source, class Sink>
+    using ListKernel = void (*)(Source&, const ScanContext&, Sink&, bool);
+
+    struct ListedFile {
+        std::wstring path;
+        size_t nameStart;
+        WIN32_FIND_DATAW data;
+        DWORD error; // Metadata lookup failure, or ERROR_DIRECTORY for a listed directory
+    };
+
+    // Fills in the enumeration data a directory walk would have produced for one listed path
+    static void describe(ListedFile& file, bool needMetadata, Pacer* pacer) {
+        size_t lastSlash = file.path.find_last_of(L'\\');
+        file.nameStart = (lastSlash == std::wstring::npos) ? 0 : lastSlash + 1;
+        file.data = {};
+        file.error = 0;
+        wcsncpy_s(file.data.cFileName, MAX_PATH, file.path.c_str() + file.nameStart, _TRUNCATE);
+        if (pacer) pacer->wait();
+        if (!needMetadata) {
+            // Still makes sure the path exists and is a file, so -b, --count and --execute never see others
+            DWORD attributes = GetFileAttributesW(file.path.c_str());
+            if (attributes == INVALID_FILE_ATTRIBUTES) file.error = GetLastError();
+            else if (attributes & FILE_ATTRIBUTE_DIRECTORY) file.error = ERROR_DIRECTORY;
+            else file.data.dwFileAttributes = attributes;
+            return;
+        }
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (!GetFileAttributesExW(file.path.c_str(), GetFileExInfoStandard, &attributes)) {
+            file.error = GetLastError();
+            return;
+        }
+        if (attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            file.error = ERROR_DIRECTORY;
+            return;
+        }
+        file.data.dwFileAttributes = attributes.dwFileAttributes;
+        file.data.ftCreationTime = attributes.ftCreationTime;
+        file.data.ftLastAccessTime = attributes.ftLastAccessTime;
+        file.data.ftLastWriteTime = attributes.ftLastWriteTime;
+        file.data.nFileSizeHigh = attributes.nFileSizeHigh;
+        file.data.nFileSizeLow = attributes.nFileSizeLow;
+    }
+
+    template <bool PathMatch, bool Filtered, class Source, class Sink>
+    static void scanList(Source& list, const ScanContext& context, Sink& sink, bool needMetadata) {
+        const size_t batchSize = 4096;
+        std::vector<ListedFile> batch(batchSize);
+        std::optional<WorkerPool> pool;
+        if (context.options.threads > 1) pool.emplace(context.options.threads);
+        std::wstring directory, pathBuffer;
+        for (size_t count = batchSize; count == batchSize;) {
+            count = 0;
+            while (count < batchSize && list.next(batch[count].path)) ++count;
+
+            if (pool) {
+                size_t sliceSize = std::max<size_t>(16, count / (pool->size() * 4) + 1);
+                for (size_t first = 0; first < count; first += sliceSize) {
+                    size_t last = std::min(count, first + sliceSize);
+                    pool->submit([&batch, first, last, needMetadata, pacer = context.pacer] {
+                        for (size_t i = first; i < last; ++i) describe(batch[i], needMetadata, pacer);
+                    });
+                }
+                pool->wait();
+            } else {
+                for (size_t i = 0; i < count; ++i) describe(batch[i], needMetadata, context.pacer);
+            }
+
+            for (size_t i = 0; i < count; ++i) {
+                const ListedFile& file = batch[i];
+                if (file.error) {
+                    if (file.error != ERROR_FILE_NOT_FOUND && file.error != ERROR_PATH_NOT_FOUND && file.error != ERROR_DIRECTORY) {
+                        std::wcerr << L"Error reading file information: " << file.error << L" File: " << file.path << std::endl;
+                    }
+                    continue;
+                }
+                directory.assign(file.path, 0, file.nameStart ? file.nameStart - 1 : 0);
+                pathBuffer.assign(file.path, 0, file.nameStart);
+                WalkEntry entry(directory, file.data, pathBuffer, file.nameStart);
+                uint64_t sampleSeed = 0;
+                if constexpr (Filtered) {
+                    if (context.options.filter.sampleThreshold) sampleSeed = hash64(directory);
+                }
+                if (admits<PathMatch, Filtered>(entry, context, sampleSeed)) deliver(entry, context, sink);
+            }
+        }
+    }
+
+    template <class Sink>
+    static SearchStats searchParallel(const std::vector<std::wstring>& roots, const PatternMatcher& matcher,
+                                      const SearchOptions& options, HardLinkSet* links, Pacer* pacer, Sink& sink) {
+        WorkerPool pool(options.threads);
+        std::vector<WorkerState<Sink>> workers(pool.size(), WorkerState<Sink>{SearchStats(), sink});
+        std::optional<ConcurrencyController> controller;
+        if (options.adaptiveStart) controller.emplace(pool, options.adaptiveStart);
+        ParallelScan<Sink> scan{ matcher, options, links, pacer, pool, workers, controller ? &*controller : nullptr };
+        // Indexed by [pathMatch][recurse][filtered]
+        static const ParallelKernel<Sink> kernels[2][2][2] = {
+            { { scanDirectoryParallel<false, false, false, Sink>, scanDirectoryParallel<false, false, true, Sink> },
+              { scanDirectoryParallel<false, true, false, Sink>, scanDirectoryParallel<false, true, true, Sink> } },
+            { { scanDirectoryParallel<true, false, false, Sink>, scanDirectoryParallel<true, false, true, Sink> },
+              { scanDirectoryParallel<true, true, false, Sink>, scanDirectoryParallel<true, true, true, Sink> } }
+        };
+        ParallelKernel<Sink> kernel = kernels[options.pathMatch][!options.shallow][options.filter.active()];
+        for (const auto& root : roots) {
+            pool.submit([&scan, kernel, root] { kernel(root, scan); });
+        }
+        pool.wait();
+
+        SearchStats stats;
+        for (auto& worker : workers) {
+            stats.merge(worker.stats);
+            sink.merge(std::move(worker.sink));
+        }
+        stats.walkerPool = pool.size();
+        stats.walkerThreads = controller ? controller->current() : pool.size();
+        if (controller) {
+            stats.walkerPeak = controller->peakLimit();
+            stats.walkerAdjustments = controller->adjustments();
+        }
+        return stats;
+    }
+
+    template <class Sink>
+    using ScanKernel = void (*)(const std::wstring&, const ScanContext&, Sink&);
+
+    template <class Sink>
+    static ScanKernel<Sink> selectKernel(const SearchOptions& options) {
+        // Indexed by [pathMatch][recurse][filtered]
+        static const ScanKernel<Sink> kernels[2][2][2] = {
+            { { scanDirectory<false, false, false, Sink>, scanDirectory<false, false, true, Sink> },
+              { scanDirectory<false, true, false, Sink>, scanDirectory<false, true, true, Sink> } },
+            { { scanDirectory<true, false, false, Sink>, scanDirectory<true, false, true, Sink> },
+              { scanDirectory<true, true, false, Sink>, scanDirectory<true, true, true, Sink> } }
+        };
+        static const ScanKernel<Sink> orderedKernels[2][2][2] = {
+            { { scanDirectoryOrdered<false, false, false, Sink>, scanDirectoryOrdered<false, false, true, Sink> },
+              { scanDirectoryOrdered<false, true, false, Sink>, scanDirectoryOrdered<false, true, true, Sink> } },
+            { { scanDirectoryOrdered<true, false, false, Sink>, scanDirectoryOrdered<true, false, true, Sink> },
+              { scanDirectoryOrdered<true, true, false, Sink>, scanDirectoryOrdered<true, true, true, Sink> } }
+        };
+        const auto& table = options.pathOrder ? orderedKernels : kernels;
+        return table[options.pathMatch][!options.shallow][options.filter.active()];
+    }
+
+    // Counts a file entry and applies the filter and the pattern
+    template <bool PathMatch, bool Filtered>
+    static bool admits(const WalkEntry& entry, const ScanContext& context, uint64_t sampleSeed) {
+        ++context.stats.entries;
+        if constexpr (Filtered) {
+            if (!context.options.filter.passes(entry.data, sampleSeed)) return false;
+        }
+        if constexpr (PathMatch) {
+            return context.matcher.matches(entry.fullPath(), context.stats);
+        } else {
+            return context.matcher.matches(entry.data.cFileName, context.stats);
+        }
+    }
+
+    // Hands an admitted file to the sink unless it is another name of a file already delivered
+    template <class Sink>
+    static void deliver(const WalkEntry& entry, const ScanContext& context, Sink& sink) {
+        if (context.links && !context.links->firstSighting(entry.fullPath())) {
+            ++context.stats.duplicateLinks;
+            return;
+        }
+        ++context.stats.matches;
+        sink.onMatch(entry);
+    }
+
+    template <bool PathMatch, bool Recurse, bool Filtered, class Sink>
+    static void scanDirectory(const std::wstring& directory, const ScanContext& context, Sink& sink) {
+        enumerateDirectory<PathMatch, Recurse, Filtered>(directory, context, sink, [&context, &sink](std::wstring subdirectory) {
+            scanDirectory<PathMatch, Recurse, Filtered, Sink>(subdirectory, context, sink);
+        });
+    }
+
+    // A parallel walk runs each directory as its own pool task, feeding the current worker's sink
+    template <bool PathMatch, bool Recurse, bool Filtered, class Sink>
+    static void scanDirectoryParallel(const std::wstring& directory, ParallelScan<Sink>& scan) {
+        WorkerState<Sink>& worker = scan.workers[WorkerPool::currentWorker()];
+        ScanContext context{ scan.matcher, scan.options, worker.stats, scan.links, scan.pacer };
+        auto started = std::chrono::steady_clock::now();
+        enumerateDirectory<PathMatch, Recurse, Filtered>(directory, context, worker.sink, [&scan](std::wstring subdirectory) {
+            scan.pool.submit([&scan, subdirectory = std::move(subdirectory)] {
+                scanDirectoryParallel<PathMatch, Recurse, Filtered, Sink>(subdirectory, scan);
+            });
+        });
+        if (scan.controller) scan.controller->record(std::chrono::steady_clock::now() - started);
+    }
+
+    // Lists one directory, handing admitted files to the sink and (when recursing) every
+    // subdirectory's path to `descend`
+    template <bool PathMatch, bool Recurse, bool Filtered, class Sink, class Descend>
+    static void enumerateDirectory(const std::wstring& directory, const ScanContext& context, Sink& sink, Descend&& descend) {
+        std::wstring pathBuffer = directory;
+        if (!pathBuffer.empty() && pathBuffer.back() != L'\\') {
+            pathBuffer += L'\\';
+        }
+        const size_t prefixLength = pathBuffer.length();
+        pathBuffer += L'*';
+
+        if (context.options.debug) {
+            std::wcout << L"Directory: " << directory << std::endl;
+            std::wcout << L"Search path: " << pathBuffer << std::endl;
+        }
+
+        if (context.pacer) context.pacer->wait();
+        WIN32_FIND_DATAW findData;
+        HANDLE hFind = FindFirstFileW(pathBuffer.c_str(), &findData);
+
+        if (hFind == INVALID_HANDLE_VALUE) {
+            reportSearchError(directory);
+            return;
+        }
+        ++context.stats.directories;
+        uint64_t sampleSeed = 0;
+        if constexpr (Filtered) {
+            if (context.options.filter.sampleThreshold) sampleSeed = hash64(directory);
+        }
+
+        do {
+            if (wcscmp(findData.cFileName, L".") == 0 || wcscmp(findData.cFileName, L"..") == 0) {
+                continue;
+            }
+
+            WalkEntry entry(directory, findData, pathBuffer, prefixLength);
+
+            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                if constexpr (Recurse) {
+                    descend(entry.fullPath());
+                }
+                continue;
+            }
+
+            if (admits<PathMatch, Filtered>(entry, context, sampleSeed)) deliver(entry, context, sink);
+        } while (FindNextFileW(hFind, &findData));
+
+        FindClose(hFind);
+        if constexpr (WantsDirectoryEnd<Sink>::value) {
+            sink.onDirectoryEnd(directory);
+        }
+    }
+
+    // --sort p: delivers matches in the exact order sortFiles would put their full paths in. Every
+    // path under a subdirectory S starts with "S\", so sorting one directory's files by name and its
+    // subdirectories by name + '\' with the same wstring comparison, then recursing in that order,
+    // yields global path order. Only the current chain of directories' admitted entries is held.
+    template <bool PathMatch, bool Recurse, bool Filtered, class Sink>
+    static void scanDirectoryOrdered(const std::wstring& directory, const ScanContext& context, Sink& sink) {
+        std::wstring pathBuffer = directory;
+        if (!pathBuffer.empty() && pathBuffer.back() != L'\\') {
+            pathBuffer += L'\\';
+        }
+        const size_t prefixLength = pathBuffer.length();
+        pathBuffer += L'*';
+
+        if (context.options.debug) {
+            std::wcout << L"Directory: " << directory << std::endl;
+            std::wcout << L"Search path: " << pathBuffer << std::endl;
+        }
+
+        if (context.pacer) context.pacer->wait();
+        WIN32_FIND_DATAW findData;
+        HANDLE hFind = FindFirstFileW(pathBuffer.c_str(), &findData);
+
+        if (hFind == INVALID_HANDLE_VALUE) {
+            reportSearchError(directory);
+            return;
+        }
+        ++context.stats.directories;
+        uint64_t sampleSeed = 0;
+        if constexpr (Filtered) {
+            if (context.options.filter.sampleThreshold) sampleSeed = hash64(directory);
+        }
+
+        struct Item {
+            std::wstring key; // Name, with a trailing '\' for directories
+            WIN32_FIND_DATAW data;
+        };
+        std::vector<Item> items;
+        do {
+            if (wcscmp(findData.cFileName, L".") == 0 || wcscmp(findData.cFileName, L"..") == 0) {
+                continue;
+            }
+
+            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                if constexpr (Recurse) {
+                    items.push_back({std::wstring(findData.cFileName) + L'\\', findData});
+                }
+                continue;
+            }
+
+            WalkEntry entry(directory, findData, pathBuffer, prefixLength);
+            if (admits<PathMatch, Filtered>(entry, context, sampleSeed)) items.push_back({findData.cFileName, findData});
+        } while (FindNextFileW(hFind, &findData));
+        FindClose(hFind);
+
+        if (context.options.pathOrder > 0) {
+            std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.key < b.key; });
+        } else {
+            std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return b.key < a.key; });
+        }
+
+        for (const Item& item : items) {
+            WalkEntry entry(directory, item.data, pathBuffer, prefixLength);
+            if (item.data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                std::wstring subdirectory = entry.fullPath();
+                scanDirectoryOrdered<PathMatch, Recurse, Filtered, Sink>(subdirectory, context, sink);
+            } else {
+                deliver(entry, context, sink);
+            }
+        }
+        if constexpr (WantsDirectoryEnd<Sink>::value) {
+            sink.onDirectoryEnd(directory);
+        }
+    }
+
+    static void reportSearchError(const std::wstring& directory) {
+        DWORD error = GetLastError();
+        if (error != ERROR_FILE_NOT_FOUND) { // Don't print error if dir just doesn't exist or is empty
+            LPVOID lpMsgBuf;
+            FormatMessageW(
+                FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+                NULL, error, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPWSTR)&lpMsgBuf, 0, NULL);
+            std::wcerr << L"Error searching directory: " << error << L" - " << (wchar_t*)lpMsgBuf << L" Directory: " << directory << std::endl;
+            LocalFree(lpMsgBuf);
+        }
+    }
+}; 
+
+// Drops roots given more than once and, unless the walk is shallow, roots inside another root, comparing
+// full paths case-insensitively. The roots that remain keep their order and the spelling they were given in.
+std::vector<std::wstring> eliminateOverlappingRoots(const std::vector<std::wstring>& roots, bool shallow, bool debug) {
+    std::vector<std::wstring> keys; // Full path with a trailing '\'
+    for (const auto& root : roots) {
+        std::wstring full(GetFullPathNameW(root.c_str(), 0, nullptr, nullptr), L'\0');
+        DWORD length = full.empty() ? 0 : GetFullPathNameW(root.c_str(), static_cast<DWORD>(full.size()), &full[0], nullptr);
+        full.resize(length && length < full.size() ? length : 0);
+        if (full.empty()) full = root;
+        if (full.back() != L'\\') full += L'\\';
+        keys.push_back(full);
+    }
+    // Shorter keys first, so every root is checked against all roots that could contain it
+    std::vector<size_t> order(roots.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a].length() < keys[b].length(); });
+    std::vector<bool> kept(roots.size(), false);
+    for (size_t k = 0; k < order.size(); ++k) {
+        size_t i = order[k];
+        kept[i] = true;
+        for (size_t j = 0; j < k && kept[i]; ++j) {
+            const std::wstring& outer = keys[order[j]];
+            if (!kept[order[j]] || (shallow && outer.length() != keys[i].length())) continue;
+            if (CompareStringOrdinal(outer.c_str(), static_cast<int>(outer.length()), keys[i].c_str(), static_cast<int>(outer.length()), TRUE) == CSTR_EQUAL) {
+                kept[i] = false;
+                if (debug) std::wcout << L"Skipping " << roots[i] << L" (covered by " << roots[order[j]] << L")" << std::endl;
+            }
+        }
+    }
+    std::vector<std::wstring> result;
+    for (size_t i = 0; i < roots.size(); ++i) {
+        if (kept[i]) result.push_back(roots[i]);
+    }
+    return result;
+}
+
+// --follow: watches every root with ReadDirectoryChangesW (one handle covers a whole subtree, so
+// directories created later need no watch of their own) and passes files that appear or change through
+// the same pattern and filters. The watches are armed before the initial search, so files created while
+// it runs, in directories it has already listed, are reported once it is done. Reported files are remembered by path hash with their
+// size and modification time, so the burst of notifications a single write causes is reported once.
+// When a notification buffer overflows, or a directory is moved in, that tree is searched again and
+// only new or changed files are reported.
+class FollowWatcher {
+public:
+    FollowWatcher(const std::vector<std::wstring>& roots, const std::wstring& pattern, const SearchOptions& options,
+                  std::function<void(const FileInfo&)> emit)
+        : roots(roots), pattern(pattern), options(options), emit(std::move(emit)) {
+        this->options.threads = 1; // Batches are small; rescans feed a sink that does not merge anyway
+    }
+
+    // Records a file the initial search reported
+    void remember(const FileInfo& file) {
+        reported[hash64(file.path)] = {file.size, timePointToFileTimeTicks(file.modificationTime)};
+    }
+
+    // Opens and arms the watches; call before the initial search
+    void start() {
+        for (const auto& root : roots) {
+            if (watches.size() == MAXIMUM_WAIT_OBJECTS) {
+                std::wcerr << L"Warning: only the first " << MAXIMUM_WAIT_OBJECTS << L" directories are followed." << std::endl;
+                break;
+            }
+            auto watch = std::make_unique<Watch>(root);
+            if (!watch->open() || !arm(*watch)) {
+                std::wcerr << L"Error watching directory: " << GetLastError() << L" Directory: " << root << std::endl;
+                continue;
+            }
+            watches.push_back(std::move(watch));
+        }
+    }
+
+    // Reports changes until interrupted. Returns only once no root can be watched any more.
+    void run() {
+        std::vector<HANDLE> events;
+        while (!watches.empty()) {
+            events.clear();
+            for (const auto& watch : watches) events.push_back(watch->overlapped.hEvent);
+            DWORD signaled = WaitForMultipleObjects(static_cast<DWORD>(events.size()), events.data(), FALSE, INFINITE);
+            if (signaled >= WAIT_OBJECT_0 + events.size()) {
+                std::wcerr << L"Error waiting for directory changes: " << GetLastError() << std::endl;
+                return;
+            }
+            size_t index = signaled - WAIT_OBJECT_0;
+            Watch& watch = *watches[index];
+            DWORD bytes = 0;
+            bool ok = GetOverlappedResult(watch.directory, &watch.overlapped, &bytes, FALSE) != 0;
+            DWORD error = ok ? 0 : GetLastError();
+            std::vector<Change> changes;
+            if (ok && bytes) changes = parse(watch);
+            ResetEvent(watch.overlapped.hEvent);
+            bool rearmed = (ok || error == ERROR_NOTIFY_ENUM_DIR) && arm(watch); // Re-issue before processing, to miss nothing
+
+            if (ok && bytes) apply(changes);
+            else if (rearmed) rescan(watch.root); // The buffer overflowed: changes were dropped
+            if (!rearmed) {
+                std::wcerr << L"Stopped following directory: " << (ok ? GetLastError() : error) << L" Directory: " << watch.root << std::endl;
+                watches.erase(watches.begin() + index);
+            }
+        }
+    }
+
+private:
+    static constexpr DWORD kBufferBytes = 64 * 1024; // Larger buffers fail on network shares
 
-        std::wstring searchPath = directory;
-        if (!searchPath.empty() && searchPath.back() != L'\\') {
-            searchPath += L'\\';
+    struct Watch {
+        explicit Watch(const std::wstring& root) : root(root), buffer(kBufferBytes / sizeof(DWORD)) {}
+        Watch(const Watch&) = delete;
+        Watch& operator=(const Watch&) = delete;
+        ~Watch() {
+            if (directory != INVALID_HANDLE_VALUE) {
+                DWORD bytes;
+                if (CancelIoEx(directory, &overlapped)) GetOverlappedResult(directory, &overlapped, &bytes, TRUE);
+                CloseHandle(directory);
+            }
+            if (overlapped.hEvent) CloseHandle(overlapped.hEvent);
         }
-        searchPath += L'*';
 
-        if (debug) {
-            std::wcout << L"Search path: " << searchPath << std::endl;
+        bool open() {
+            directory = CreateFileW(root.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                    nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+            overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+            return directory != INVALID_HANDLE_VALUE && overlapped.hEvent;
         }
 
-        WIN32_FIND_DATAW findData;
-        HANDLE hFind = FindFirstFileW(searchPath.c_str(), &findData);
+        std::wstring root;
+        HANDLE directory = INVALID_HANDLE_VALUE;
+        OVERLAPPED overlapped = {};
+        std::vector<DWORD> buffer; // DWORD-aligned, as ReadDirectoryChangesW requires
+    };
 
-        if (hFind == INVALID_HANDLE_VALUE) {
-            DWORD error = GetLastError();
-            if (error != ERROR_FILE_NOT_FOUND) { // Don't print error if dir just doesn't exist or is empty
-                LPVOID lpMsgBuf;
-                FormatMessageW(
-                    FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-                    NULL, error, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPWSTR)&lpMsgBuf, 0, NULL);
-                std::wcerr << L"Error searching directory: " << error << L" - " << (wchar_t*)lpMsgBuf << L" Directory: " << directory << std::endl;
-                LocalFree(lpMsgBuf);
-            }
-            return results;
+    struct Change {
+        std::wstring path;
+        DWORD action;
+    };
+
+    // Size and modification time of a reported file. Times are kept at the whole-second precision of
+    // FileInfo, which is all remember() gets for files from the initial listing.
+    struct Seen {
+        uintmax_t size;
+        ULONGLONG modified;
+        bool operator==(const Seen& other) const { return size == other.size && modified == other.modified; }
+    };
+
+    // Yields a batch of changed files to FileFinder::searchList
+    struct ChangedFiles {
+        const std::vector<std::wstring>& paths;
+        size_t next_ = 0;
+        bool next(std::wstring& path) {
+            if (next_ == paths.size()) return false;
+            path = paths[next_++];
+            return true;
         }
+    };
 
-        do {
-            if (wcscmp(findData.cFileName, L".") == 0 || wcscmp(findData.cFileName, L"..") == 0) {
-                continue;
-            }
+    // Reports a match unless it was already reported with the same size and modification time
+    class ReportSink {
+    public:
+        explicit ReportSink(FollowWatcher& watcher) : watcher(watcher) {}
 
-            std::wstring fullPath = directory;
-            if (!fullPath.empty() && fullPath.back() != L'\\') {
-                fullPath += L'\\';
+        void onMatch(const WalkEntry& entry) {
+            const std::wstring& path = entry.fullPath();
+            Seen seen = {fileSizeOf(entry.data), timePointToFileTimeTicks(fileTimeToTimePoint(entry.data.ftLastWriteTime))};
+            auto inserted = watcher.reported.try_emplace(hash64(path), seen);
+            if (!inserted.second) {
+                if (inserted.first->second == seen) return;
+                inserted.first->second = seen;
             }
-            fullPath += findData.cFileName;
+            watcher.emit(makeFileInfo(path, entry.data));
+        }
 
-            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-                if (!shallow) {
-                    std::vector<FileInfo> subDirResults = findFiles(fullPath, pattern, useRegex, shallow, debug, pathMatch);
-                    results.insert(results.end(), subDirResults.begin(), subDirResults.end());
-                }
-            } else {
-                std::wstring stringToMatch = pathMatch ? fullPath : findData.cFileName;
-                if (std::regex_search(stringToMatch, regexPattern)) {
-                    FileInfo info;
-                    info.path = fullPath;
-
-                    FILETIME ftCreate = findData.ftCreationTime;
-                    FILETIME ftWrite = findData.ftLastWriteTime;
-                    SYSTEMTIME stCreate, stWrite;
-                    FileTimeToSystemTime(&ftCreate, &stCreate);
-                    FileTimeToSystemTime(&ftWrite, &stWrite);
-
-                    tm tmCreate = {};
-                    tmCreate.tm_sec = stCreate.wSecond;
-                    tmCreate.tm_min = stCreate.wMinute;
-                    tmCreate.tm_hour = stCreate.wHour;
-                    tmCreate.tm_mday = stCreate.wDay;
-                    tmCreate.tm_mon = stCreate.wMonth - 1;
-                    tmCreate.tm_year = stCreate.wYear - 1900;
-                    tmCreate.tm_isdst = -1;
-                    info.creationTime = std::chrono::system_clock::from_time_t(_mkgmtime(&tmCreate));
-                    
-                    tm tmWrite = {};
-                    tmWrite.tm_sec = stWrite.wSecond;
-                    tmWrite.tm_min = stWrite.wMinute;
-                    tmWrite.tm_hour = stWrite.wHour;
-                    tmWrite.tm_mday = stWrite.wDay;
-                    tmWrite.tm_mon = stWrite.wMonth - 1;
-                    tmWrite.tm_year = stWrite.wYear - 1900;
-                    tmWrite.tm_isdst = -1;
-                    info.modificationTime = std::chrono::system_clock::from_time_t(_mkgmtime(&tmWrite));
-
-                    ULARGE_INTEGER fileSize;
-                    fileSize.LowPart = findData.nFileSizeLow;
-                    fileSize.HighPart = findData.nFileSizeHigh;
-                    info.size = fileSize.QuadPart;
-                    results.push_back(info);
-                }
-            }
-        } while (FindNextFileW(hFind, &findData));
+    private:
+        FollowWatcher& watcher;
+    };
 
-        FindClose(hFind);
-        return results;
+    std::vector<std::wstring> roots;
+    std::wstring pattern;
+    SearchOptions options;
+    std::function<void(const FileInfo&)> emit;
+    std::unordered_map<uint64_t, Seen> reported;
+    std::vector<std::unique_ptr<Watch>> watches;
+
+    bool arm(Watch& watch) {
+        const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+        return ReadDirectoryChangesW(watch.directory, watch.buffer.data(), kBufferBytes, !options.shallow, filter, nullptr, &watch.overlapped, nullptr) != 0;
     }
 
-private:
-    static std::wstring dosPatternToRegex(const std::wstring& pattern, bool pathMatch) {
-        std::wstring result;
-        result.reserve(pattern.length() * 2);
-        if (!pathMatch) result += L'^';
+    // Copies the changes out of the notification buffer so it can be re-armed at once
+    std::vector<Change> parse(const Watch& watch) const {
+        std::vector<Change> changes;
+        const char* record = reinterpret_cast<const char*>(watch.buffer.data());
+        for (;;) {
+            const auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(record);
+            std::wstring relative(info->FileName, info->FileNameLength / sizeof(wchar_t));
+            std::wstring path = (!watch.root.empty() && watch.root.back() != L'\\') ? watch.root + L'\\' + relative : watch.root + relative;
+            changes.push_back({std::move(path), info->Action});
+            if (!info->NextEntryOffset) break;
+            record += info->NextEntryOffset;
+        }
+        return changes;
+    }
 
-        for (wchar_t c : pattern) {
-            switch (c) {
-                case L'*': result += L".*"; break;
-                case L'?': result += L"."; break;
-                case L'.': case L'[': case L']': case L'(': case L')':
-                case L'{': case L'}': case L'+': case L'^': case L'$':
-                case L'|': case L'\\':
-                    result += L'\\';
-                    result += c;
-                    break;
-                default: result += c; break;
+    void apply(const std::vector<Change>& changes) {
+        std::vector<std::wstring> files;
+        std::unordered_set<std::wstring> queued;
+        for (const Change& change : changes) {
+            if (change.action == FILE_ACTION_REMOVED || change.action == FILE_ACTION_RENAMED_OLD_NAME) {
+                reported.erase(hash64(change.path)); // A file recreated with the same size and time is new again
+                queued.erase(change.path);
+                continue;
+            }
+            if (!queued.insert(change.path).second) continue;
+            DWORD attributes = GetFileAttributesW(change.path.c_str());
+            if (attributes == INVALID_FILE_ATTRIBUTES) continue; // Already gone
+            if (attributes & FILE_ATTRIBUTE_DIRECTORY) {
+                // A directory moved in brings files no notification mentions
+                if (change.action != FILE_ACTION_MODIFIED && !options.shallow) rescan(change.path);
+                continue;
             }
+            files.push_back(change.path);
         }
-        if (!pathMatch) result += L'$';
-        return result;
+        files.erase(std::remove_if(files.begin(), files.end(), [&queued](const std::wstring& path) { return !queued.count(path); }), files.end());
+        if (files.empty()) return;
+        ChangedFiles source{files};
+        ReportSink sink(*this);
+        FileFinder::searchList(source, pattern, options, true, sink);
     }
-}; 
+
+    void rescan(const std::wstring& directory) {
+        ReportSink sink(*this);
+        FileFinder::search({directory}, pattern, options, sink);
+    }
+};
 
 // Execute a command with substituted parameters
 bool executeCommand(const std::wstring& commandTemplate, const FileInfo& fileInfo, bool dryRun, bool debugMode) {
@@ -403,6 +3227,16 @@ bool executeCommand(const std::wstring& commandTemplate, const FileInfo& fileInf
     return success;
 }
 
+// Local time as shown in the listing columns; tab mode adds seconds
+std::wstring formatTime(const std::chrono::system_clock::time_point& timePoint, bool withSeconds) {
+    auto tt = std::chrono::system_clock::to_time_t(timePoint);
+    struct tm timeinfo;
+    localtime_s(&timeinfo, &tt);
+    wchar_t buffer[20];
+    wcsftime(buffer, 20, withSeconds ? L"%Y-%m-%d %H:%M:%S" : L"%Y-%m-%d %H:%M", &timeinfo);
+    return std::wstring(buffer);
+}
+
 // Definition of printFileInfo (NO default arguments here)
 void printFileInfo(const FileInfo& info, bool singleTabMode, bool bareMode, bool verboseMode, bool conciseMode, const std::wstring& directory, const std::wstring& filename) {
     if (bareMode) {
@@ -414,16 +3248,8 @@ void printFileInfo(const FileInfo& info, bool singleTabMode, bool bareMode, bool
          displayItemPath = directory; // For verbose-concise, first part is directory
     }
 
-    auto formatTime = [singleTabMode](const auto& timePoint) {
-        auto tt = std::chrono::system_clock::to_time_t(timePoint);
-        struct tm timeinfo;
-        localtime_s(&timeinfo, &tt);
-        wchar_t buffer[20];
-        wcsftime(buffer, 20, singleTabMode ? L"%Y-%m-%d %H:%M:%S" : L"%Y-%m-%d %H:%M", &timeinfo);
-        return std::wstring(buffer);
-    };
-    std::wstring createdTimeStr = formatTime(info.creationTime);
-    std::wstring modifiedTimeStr = formatTime(info.modificationTime);
+    std::wstring createdTimeStr = formatTime(info.creationTime, singleTabMode);
+    std::wstring modifiedTimeStr = formatTime(info.modificationTime, singleTabMode);
 
     if (singleTabMode) {
         if (verboseMode && conciseMode) {
@@ -539,8 +3365,320 @@ void printFilesVerbose(const std::vector<FileInfo>& files, bool singleTabMode, b
     }
 }
 
+// Summary for --count and --sum-size
+void printAggregateSummary(const AggregateStats& totals, bool countOnly, bool singleTabMode, bool conciseMode) {
+    if (countOnly) {
+        if (conciseMode) std::wcout << totals.count << std::endl;
+        else std::wcout << L"Found " << totals.count << L" files" << std::endl;
+        return;
+    }
+    std::wstring minSize = totals.count ? std::to_wstring(totals.minSize) : L"-";
+    std::wstring maxSize = totals.count ? std::to_wstring(totals.maxSize) : L"-";
+    std::wstring oldest = totals.count ? formatTime(fileTimeTicksToTimePoint(totals.oldestModified), singleTabMode) : L"-";
+    std::wstring newest = totals.count ? formatTime(fileTimeTicksToTimePoint(totals.newestModified), singleTabMode) : L"-";
+    if (singleTabMode) {
+        if (!conciseMode) std::wcout << L"Files\tTotal Size\tMin Size\tMax Size\tOldest Modified\tNewest Modified" << std::endl;
+        std::wcout << totals.count << L'\t' << totals.totalSize << L'\t' << minSize << L'\t' << maxSize
+                   << L'\t' << oldest << L'\t' << newest << std::endl;
+        return;
+    }
+    std::wcout << L"Files:           " << totals.count << std::endl;
+    std::wcout << L"Total size:      " << totals.totalSize << L" bytes (" << (totals.totalSize + 1023) / 1024 << L" KB)" << std::endl;
+    std::wcout << L"Smallest:        " << minSize << (totals.count ? L" bytes" : L"") << std::endl;
+    std::wcout << L"Largest:         " << maxSize << (totals.count ? L" bytes" : L"") << std::endl;
+    std::wcout << L"Oldest modified: " << oldest << std::endl;
+    std::wcout << L"Newest modified: " << newest << std::endl;
+}
+
+// Prints --sample estimates. Each file was kept independently with probability `fraction`, so totals
+// scale by 1/fraction (Horvitz-Thompson) with variance (1 - fraction) / fraction^2 * sum(y^2) over
+// the sample; the interval is the 95% normal approximation.
+void printSampleEstimate(const SampleSink& sample, double fraction, bool countOnly, bool singleTabMode, bool conciseMode) {
+    const double z = 1.96;
+    const AggregateStats& totals = sample.totals;
+    double files = totals.count / fraction;
+    double filesMargin = z * std::sqrt((1 - fraction) * totals.count) / fraction;
+    double bytes = static_cast<double>(totals.totalSize) / fraction;
+    double bytesMargin = z * std::sqrt((1 - fraction) * sample.sumSquares) / fraction;
+    auto rounded = [](double value) { return static_cast<uint64_t>(std::max(0.0, value) + 0.5); };
+
+    if (singleTabMode) {
+        if (!conciseMode) {
+            std::wcout << L"Files\tFiles Low\tFiles High";
+            if (!countOnly) std::wcout << L"\tTotal Size\tTotal Size Low\tTotal Size High";
+            std::wcout << L"\tSampled Files\tSample Fraction" << std::endl;
+        }
+        std::wcout << rounded(files) << L'\t' << rounded(files - filesMargin) << L'\t' << rounded(files + filesMargin);
+        if (!countOnly) std::wcout << L'\t' << rounded(bytes) << L'\t' << rounded(bytes - bytesMargin) << L'\t' << rounded(bytes + bytesMargin);
+        std::wcout << L'\t' << totals.count << L'\t' << fraction << std::endl;
+        return;
+    }
+    if (conciseMode) {
+        std::wcout << rounded(files);
+        if (!countOnly) std::wcout << L'\t' << rounded(bytes);
+        std::wcout << std::endl;
+        return;
+    }
+    std::wcout << L"Sampled:         " << totals.count << L" matching files in a " << fraction * 100 << L"% sample" << std::endl;
+    std::wcout << L"Files:           ~" << rounded(files) << L" (95% CI " << rounded(files - filesMargin) << L" - " << rounded(files + filesMargin) << L")" << std::endl;
+    if (!countOnly) {
+        std::wcout << L"Total size:      ~" << rounded(bytes) << L" bytes (95% CI " << rounded(bytes - bytesMargin) << L" - " << rounded(bytes + bytesMargin) << L")" << std::endl;
+    }
+}
+
+// Prints aggregate report rows (--rollup, --group-by) in the same tab/formatted/bare styles as the file listing
+void printAggregateRows(const std::vector<AggregateRow>& rows, const wchar_t* keyHeader, const wchar_t* rowNoun,
+                        bool singleTabMode, bool conciseMode, bool bareMode) {
+    if (bareMode) {
+        for (const auto& row : rows) std::wcout << row.info.path << std::endl;
+        return;
+    }
+    const int countCol = 8, sizeCol = 10, dateCol = 16, spacing = 2;
+    int keyCol = getConsoleWidth() - countCol - (3 * sizeCol) - (2 * dateCol) - (6 * spacing);
+    if (keyCol < 20) keyCol = 20;
+
+    if (!conciseMode) {
+        if (singleTabMode) {
+            std::wcout << keyHeader << L"\tFiles\tTotal Size\tMin Size\tMax Size\tOldest Modified\tNewest Modified" << std::endl;
+        } else {
+            std::wcout << std::left << std::setw(keyCol) << keyHeader
+                       << std::wstring(spacing, L' ') << std::right << std::setw(countCol) << L"Files"
+                       << std::wstring(spacing, L' ') << std::right << std::setw(sizeCol) << L"Total (KB)"
+                       << std::wstring(spacing, L' ') << std::right << std::setw(sizeCol) << L"Min (KB)"
+                       << std::wstring(spacing, L' ') << std::right << std::setw(sizeCol) << L"Max (KB)"
+                       << std::wstring(spacing, L' ') << std::right << std::setw(dateCol) << L"Oldest"
+                       << std::wstring(spacing, L' ') << std::right << std::setw(dateCol) << L"Newest"
+                       << std::endl;
+            std::wcout << std::wstring(keyCol, L'-')
+                       << std::wstring(spacing, L' ') << std::wstring(countCol, L'-')
+                       << std::wstring(spacing, L' ') << std::wstring(sizeCol, L'-')
+                       << std::wstring(spacing, L' ') << std::wstring(sizeCol, L'-')
+                       << std::wstring(spacing, L' ') << std::wstring(sizeCol, L'-')
+                       << std::wstring(spacing, L' ') << std::wstring(dateCol, L'-')
+                       << std::wstring(spacing, L' ') << std::wstring(dateCol, L'-')
+                       << std::endl;
+        }
+    }
+
+    for (const auto& row : rows) {
+        const AggregateStats& stats = row.stats;
+        std::wstring oldest = formatTime(row.info.creationTime, singleTabMode);
+        std::wstring newest = formatTime(row.info.modificationTime, singleTabMode);
+        if (singleTabMode) {
+            std::wcout << row.info.path << L'\t' << stats.count << L'\t' << stats.totalSize << L'\t' << stats.minSize
+                       << L'\t' << stats.maxSize << L'\t' << oldest << L'\t' << newest << std::endl;
+            continue;
+        }
+        std::wstring key = row.info.path;
+        if (key.length() > static_cast<size_t>(keyCol)) key = key.substr(0, keyCol - 3) + L"...";
+        std::wcout << std::left << std::setw(keyCol) << key
+                   << std::wstring(spacing, L' ') << std::right << std::setw(countCol) << stats.count
+                   << std::wstring(spacing, L' ') << std::right << std::setw(sizeCol) << (stats.totalSize + 1023) / 1024
+                   << std::wstring(spacing, L' ') << std::right << std::setw(sizeCol) << (stats.minSize + 1023) / 1024
+                   << std::wstring(spacing, L' ') << std::right << std::setw(sizeCol) << (stats.maxSize + 1023) / 1024
+                   << std::wstring(spacing, L' ') << std::right << std::setw(dateCol) << oldest
+                   << std::wstring(spacing, L' ') << std::right << std::setw(dateCol) << newest
+                   << std::endl;
+    }
+
+    if (!conciseMode) std::wcout << L"Found " << rows.size() << L" " << rowNoun << std::endl;
+}
+
+// Prints a --histogram as aligned text with a proportional bar, tab-separated values or JSON
+void printHistogram(const std::vector<HistogramSink::Bucket>& buckets, HistogramKind kind,
+                    bool singleTabMode, bool conciseMode, bool jsonMode) {
+    const wchar_t* unit = (kind == HistogramKind::Size) ? L"bytes" : L"days";
+    uint64_t totalCount = 0, maxCount = 0;
+    for (const auto& bucket : buckets) {
+        totalCount += bucket.count;
+        maxCount = std::max(maxCount, bucket.count);
+    }
+
+    if (jsonMode) {
+        std::wcout << L"{\"histogram\":\"" << (kind == HistogramKind::Size ? L"size" : L"age") << L"\",\"unit\":\""
+                   << unit << L"\",\"files\":" << totalCount << L",\"buckets\":[";
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            const auto& bucket = buckets[i];
+            std::wcout << (i ? L"," : L"") << L"{\"label\":\"" << bucket.label << L"\",\"min\":" << bucket.lower
+                       << L",\"max\":";
+            if (bucket.upper) std::wcout << *bucket.upper; else std::wcout << L"null";
+            std::wcout << L",\"files\":" << bucket.count << L",\"totalSize\":" << bucket.totalSize << L"}";
+        }
+        std::wcout << L"]}" << std::endl;
+        return;
+    }
+
+    if (singleTabMode) {
+        if (!conciseMode) std::wcout << L"Range\tMin " << unit << L"\tMax " << unit << L"\tFiles\tTotal Size" << std::endl;
+        for (const auto& bucket : buckets) {
+            std::wcout << bucket.label << L'\t' << bucket.lower << L'\t';
+            if (bucket.upper) std::wcout << *bucket.upper;
+            std::wcout << L'\t' << bucket.count << L'\t' << bucket.totalSize << std::endl;
+        }
+        return;
+    }
+
+    const int labelCol = 16, countCol = 10, sizeCol = 12, percentCol = 6, barWidth = 30, spacing = 2;
+    if (!conciseMode) {
+        std::wcout << std::left << std::setw(labelCol) << (kind == HistogramKind::Size ? L"Size" : L"Age")
+                   << std::wstring(spacing, L' ') << std::right << std::setw(countCol) << L"Files"
+                   << std::wstring(spacing, L' ') << std::right << std::setw(sizeCol) << L"Total (KB)"
+                   << std::wstring(spacing, L' ') << std::right << std::setw(percentCol) << L"%"
+                   << std::endl;
+        std::wcout << std::wstring(labelCol, L'-')
+                   << std::wstring(spacing, L' ') << std::wstring(countCol, L'-')
+                   << std::wstring(spacing, L' ') << std::wstring(sizeCol, L'-')
+                   << std::wstring(spacing, L' ') << std::wstring(percentCol, L'-')
+                   << std::endl;
+    }
+    std::ios_base::fmtflags savedFlags = std::wcout.flags();
+    std::streamsize savedPrecision = std::wcout.precision();
+    for (const auto& bucket : buckets) {
+        double percent = totalCount ? 100.0 * bucket.count / totalCount : 0.0;
+        size_t bar = maxCount ? static_cast<size_t>((bucket.count * barWidth + maxCount - 1) / maxCount) : 0;
+        std::wcout << std::left << std::setw(labelCol) << bucket.label
+                   << std::wstring(spacing, L' ') << std::right << std::setw(countCol) << bucket.count
+                   << std::wstring(spacing, L' ') << std::right << std::setw(sizeCol) << (bucket.totalSize + 1023) / 1024
+                   << std::wstring(spacing, L' ') << std::right << std::setw(percentCol) << std::fixed << std::setprecision(1) << percent
+                   << std::wstring(spacing, L' ') << std::wstring(bar, L'#')
+                   << std::endl;
+    }
+    std::wcout.flags(savedFlags);
+    std::wcout.precision(savedPrecision);
+    if (!conciseMode) std::wcout << L"Found " << totalCount << L" files" << std::endl;
+}
+
+// Prints the --quantiles/--distinct report as labelled lines, tab-separated name/value rows or JSON
+void printSketchReport(const SketchSink& sink, bool sizeQuantiles, std::optional<GroupField> distinctField,
+                       bool singleTabMode, bool conciseMode, bool jsonMode) {
+    static const std::pair<const wchar_t*, double> points[] = {{L"p50", 0.5}, {L"p90", 0.9}, {L"p99", 0.99}, {L"p99.9", 0.999}};
+    static const wchar_t* fieldNames[] = {L"ext", L"dir", L"owner", L"mtime-month"};
+    const AggregateStats& totals = sink.totals;
+    std::vector<std::pair<std::wstring, uint64_t>> values;
+    if (sizeQuantiles && totals.count) {
+        values.emplace_back(L"min", totals.minSize);
+        for (const auto& point : points) {
+            // Clamp to the exact extremes, which the sketch may have compacted away
+            uint64_t value = std::clamp<uint64_t>(sink.sizes.quantile(point.second), totals.minSize, totals.maxSize);
+            values.emplace_back(point.first, value);
+        }
+        values.emplace_back(L"max", totals.maxSize);
+    }
+    const wchar_t* distinctName = distinctField ? fieldNames[static_cast<int>(*distinctField)] : L"";
+
+    if (jsonMode) {
+        std::wcout << L"{\"files\":" << totals.count;
+        if (sizeQuantiles) {
+            std::wcout << L",\"sizeQuantiles\":{";
+            for (size_t i = 0; i < values.size(); ++i) std::wcout << (i ? L"," : L"") << L"\"" << values[i].first << L"\":" << values[i].second;
+            std::wcout << L"}";
+        }
+        if (distinctField) std::wcout << L",\"distinct\":{\"field\":\"" << distinctName << L"\",\"estimate\":" << sink.distinct.estimate() << L"}";
+        std::wcout << L"}" << std::endl;
+        return;
+    }
+
+    if (singleTabMode) {
+        if (!conciseMode) std::wcout << L"Statistic\tValue" << std::endl;
+        std::wcout << L"files\t" << totals.count << std::endl;
+        for (const auto& value : values) std::wcout << L"size " << value.first << L'\t' << value.second << std::endl;
+        if (distinctField) std::wcout << L"distinct " << distinctName << L'\t' << sink.distinct.estimate() << std::endl;
+        return;
+    }
+
+    std::wcout << L"Files:           " << totals.count << std::endl;
+    if (sizeQuantiles) {
+        if (!conciseMode) std::wcout << L"Size quantiles (approximate):" << std::endl;
+        for (const auto& value : values) {
+            std::wcout << L"  " << std::left << std::setw(8) << value.first << std::right << std::setw(16) << value.second << L" bytes" << std::endl;
+        }
+    }
+    if (distinctField) {
+        std::wcout << L"Distinct " << distinctName << L": " << (conciseMode ? L"" : L"~") << sink.distinct.estimate() << std::endl;
+    }
+}
+
+// Prints --snapshot changes as "<tag> <path>" lines (tab mode adds size and modification time)
+void printSnapshotChanges(const std::vector<SnapshotChange>& changes, bool singleTabMode, bool conciseMode, bool bareMode) {
+    size_t counts[3] = {};
+    for (const auto& change : changes) {
+        ++counts[change.tag == L'A' ? 0 : change.tag == L'R' ? 1 : 2];
+        if (bareMode) {
+            std::wcout << change.path << std::endl;
+        } else if (singleTabMode) {
+            std::wcout << change.tag << L'\t' << change.path << L'\t' << change.record.size << L'\t'
+                       << formatTime(fileTimeTicksToTimePoint(change.record.modified), true) << std::endl;
+        } else {
+            std::wcout << change.tag << L"  " << change.path << std::endl;
+        }
+    }
+    if (!conciseMode && !bareMode) {
+        std::wcout << L"Added: " << counts[0] << L", Removed: " << counts[1] << L", Modified: " << counts[2] << std::endl;
+    }
+}
+
+// Prints --diff results as "<tag>  <relative path>" (tab mode adds both sizes and modification times)
+void printTreeDifferences(const std::vector<TreeDiff::Difference>& differences, bool singleTabMode, bool conciseMode, bool bareMode) {
+    size_t missing = 0, extra = 0, size = 0, time = 0, content = 0;
+    auto formatTicks = [](ULONGLONG ticks) { return ticks ? formatTime(fileTimeTicksToTimePoint(ticks), true) : std::wstring(); };
+    if (singleTabMode && !conciseMode && !bareMode) std::wcout << L"Change\tPath\tSize 1\tSize 2\tModified 1\tModified 2" << std::endl;
+    for (const auto& difference : differences) {
+        switch (difference.tag) {
+            case L'-': ++missing; break;
+            case L'+': ++extra; break;
+            case L'S': ++size; break;
+            case L'T': ++time; break;
+            default: ++content; break;
+        }
+        if (bareMode) {
+            std::wcout << difference.path << std::endl;
+        } else if (singleTabMode) {
+            std::wcout << difference.tag << L'\t' << difference.path << L'\t';
+            if (difference.tag != L'+') std::wcout << difference.leftSize;
+            std::wcout << L'\t';
+            if (difference.tag != L'-') std::wcout << difference.rightSize;
+            std::wcout << L'\t' << formatTicks(difference.leftModified) << L'\t' << formatTicks(difference.rightModified) << std::endl;
+        } else {
+            std::wcout << difference.tag << L"  " << difference.path << std::endl;
+        }
+    }
+    if (!conciseMode && !bareMode) {
+        std::wcout << L"Only in first: " << missing << L", Only in second: " << extra << L", Size differs: " << size
+                   << L", Time differs: " << time << L", Content differs: " << content << std::endl;
+    }
+}
+
+// Search statistics go to stderr so they never mix with parsable output
+void printSearchStats(const SearchStats& stats, double seconds) {
+    auto percent = [](uint64_t part, uint64_t whole) {
+        std::wstringstream ss;
+        ss << std::fixed << std::setprecision(1) << (whole ? 100.0 * part / whole : 0.0) << L'%';
+        return ss.str();
+    };
+    std::wcerr << L"Statistics:" << std::endl;
+    std::wcerr << L"  Directories scanned: " << stats.directories << std::endl;
+    std::wcerr << L"  Files examined:      " << stats.entries << std::endl;
+    if (stats.prefilterTested) {
+        std::wcerr << L"  Literal prefilter:   " << stats.prefilterPassed << L" of " << stats.prefilterTested
+                   << L" passed (" << percent(stats.prefilterPassed, stats.prefilterTested) << L")" << std::endl;
+    }
+    std::wcerr << L"  Regex evaluations:   " << stats.regexRuns << std::endl;
+    std::wcerr << L"  Files matched:       " << stats.matches << std::endl;
+    if (stats.duplicateLinks) std::wcerr << L"  Extra hard links:    " << stats.duplicateLinks << L" (skipped)" << std::endl;
+    if (stats.walkerPool) {
+        std::wcerr << L"  Walker threads:      " << stats.walkerThreads << L" of " << stats.walkerPool;
+        if (stats.walkerPeak) std::wcerr << L" (adaptive, peak " << stats.walkerPeak << L", " << stats.walkerAdjustments << L" adjustments)";
+        std::wcerr << std::endl;
+    }
+    std::wcerr << L"  Elapsed:             " << std::fixed << std::setprecision(3) << seconds << L" s";
+    if (seconds > 0) std::wcerr << L" (" << static_cast<uint64_t>(stats.entries / seconds) << L" files/s)";
+    std::wcerr << std::endl;
+}
+
 void printUsage(const wchar_t* programName) {
-    std::wcout << L"Usage: " << programName << L" <directory> <pattern> [options]" << std::endl;
+    std::wcout << L"Usage: " << programName << L" <directory> [<directory>...] <pattern> [options]" << std::endl;
+    std::wcout << L"       Several directories are searched in one run (overlapping ones only once); the last" << std::endl;
+    std::wcout << L"       argument is then the pattern." << std::endl;
     std::wcout << L"Options:" << std::endl;
     std::wcout << L"  -r, --regex          Treat pattern as regex instead of DOS wildcard" << std::endl;
     std::wcout << L"  -s, --shallow        Shallow search (do not recurse into subdirectories)" << std::endl;
@@ -554,6 +3692,7 @@ void printUsage(const wchar_t* programName) {
     std::wcout << L"                       headers with files listed below. In concise mode, splits" << std::endl;
     std::wcout << L"                       path into separate directory and filename columns." << std::endl;
     std::wcout << L"  -P, --path-match     Match pattern against full path instead of filename" << std::endl;
+    std::wcout << L"  --exclude <pattern>  Skip files matching this pattern (same syntax as <pattern>, repeatable)" << std::endl;
     std::wcout << L"  -8, --utf8           Output in UTF-8 encoding (default is UTF-16 for Unicode preservation)" << std::endl;
     std::wcout << L"  --sort <order>       Sort results by specified criteria" << std::endl;
     std::wcout << L"                       p=path, n=name, s=size, c=created date, m=modified date" << std::endl;
@@ -563,7 +3702,47 @@ void printUsage(const wchar_t* programName) {
     std::wcout << L"  --date-modified-start <date> Filter files modified on or after this date (inclusive)" << std::endl;
     std::wcout << L"  --date-modified-end <date>   Filter files modified before this date (exclusive)" << std::endl;
     std::wcout << L"                       Date formats: YYYYMMDD[HHMM[SS]], YYYY/MM/DD[-HH:MM[:SS]]" << std::endl;
+    std::wcout << L"  --min-size <size>    Only files at least this large (inclusive)" << std::endl;
+    std::wcout << L"  --max-size <size>    Only files at most this large (inclusive)" << std::endl;
+    std::wcout << L"                       Size units: K, M, G, T (1024-based), e.g. 100M or 1.5G" << std::endl;
+    std::wcout << L"  --per-dir-top <n>    List only the first <n> files of each directory in --sort order" << std::endl;
+    std::wcout << L"                       (default -m, newest first)" << std::endl;
+    std::wcout << L"  --per-dir-rest <n>   List all but the first <n> files of each directory (e.g. to --execute a cleanup)" << std::endl;
     std::wcout << L"  --dry-run            Show commands that would be executed without running them." << std::endl;
+    std::wcout << L"  --dedup-links        List and count a file with several hard links only once (opens each" << std::endl;
+    std::wcout << L"                       matched file to read its file ID)" << std::endl;
+    std::wcout << L"  --count              Only count matching files (no listing)" << std::endl;
+    std::wcout << L"  --sum-size           Only print totals: count, total/min/max size, oldest/newest date" << std::endl;
+    std::wcout << L"  --sample <percent>   With --count/--sum-size: examine only a deterministic, path-hash" << std::endl;
+    std::wcout << L"                       selected percentage of files and print estimates with 95% intervals" << std::endl;
+    std::wcout << L"  --rollup [depth]     Report matched file counts and sizes per directory, including" << std::endl;
+    std::wcout << L"                       subdirectories, down to [depth] levels (default: all); sorted" << std::endl;
+    std::wcout << L"                       largest first unless --sort is given" << std::endl;
+    std::wcout << L"  --group-by <field>   Report count and total/min/max size of matched files per group:" << std::endl;
+    std::wcout << L"                       ext, dir, owner or mtime-month (local time)" << std::endl;
+    std::wcout << L"  --histogram <kind>   Report matched files in buckets instead of listing them:" << std::endl;
+    std::wcout << L"                       size (powers of two) or age (days/weeks/months/years since modified)" << std::endl;
+    std::wcout << L"  --quantiles size     Report approximate size percentiles (p50/p90/p99/p99.9) in constant memory" << std::endl;
+    std::wcout << L"  --distinct <field>   Report the approximate number of distinct ext, dir, owner or mtime-month values" << std::endl;
+    std::wcout << L"  --json               Print the --histogram, --quantiles or --distinct report as JSON" << std::endl;
+    std::wcout << L"  --diff <dir2>        Compare the matching files under <directory> with those under <dir2>:" << std::endl;
+    std::wcout << L"                       - only in first, + only in second, S size differs, T modified time differs" << std::endl;
+    std::wcout << L"  --diff-content       With --diff, also compare the contents of same-size files (C content differs)" << std::endl;
+    std::wcout << L"  --snapshot <file>    Print only files added (A), removed (R) or modified (M) since the" << std::endl;
+    std::wcout << L"                       snapshot in <file>, then update it (all files are added on first run)" << std::endl;
+    std::wcout << L"  --from-list <file>   Check the paths listed in <file> (- for standard input) instead of" << std::endl;
+    std::wcout << L"                       searching a directory; one per line or NUL-separated, UTF-8 or UTF-16" << std::endl;
+    std::wcout << L"                       with BOM. The only argument is then the (optional) pattern." << std::endl;
+    std::wcout << L"  --follow             After listing (or executing on) the matches, keep watching the directories" << std::endl;
+    std::wcout << L"                       and list or execute on each file that appears or changes and matches," << std::endl;
+    std::wcout << L"                       until interrupted (Ctrl+C)" << std::endl;
+    std::wcout << L"  --threads <n|auto>   Walk directories with <n> threads, or with auto let the walk find how many" << std::endl;
+    std::wcout << L"                       the storage rewards (default: auto when several directories are given," << std::endl;
+    std::wcout << L"                       otherwise 1). Unsorted parallel listings are printed in path order." << std::endl;
+    std::wcout << L"  --background         Run at background I/O and memory priority and below-normal CPU priority" << std::endl;
+    std::wcout << L"  --pace <n>           List at most <n> directories per second (with --from-list, look up at most" << std::endl;
+    std::wcout << L"                       <n> files per second), across all threads" << std::endl;
+    std::wcout << L"  --stats              Print search statistics (to stderr) when done" << std::endl;
     std::wcout << L"  -h, --help           Display this help message" << std::endl;
 } 
 
@@ -600,15 +3779,37 @@ int main(int /*argc_c*/, char* /*argv_c*/[]) {
         _setmode(_fileno(stderr), _O_U16TEXT);
     }
 
-    std::wstring directory;
+    std::vector<std::wstring> roots;
     std::wstring pattern = L"*";
     bool useRegex = false, shallow = false, debug = false, singleTabMode = false;
     bool conciseMode = false, bareMode = false, verboseMode = false, pathMatchMode = false;
     std::optional<std::wstring> command, sortOption;
-    bool dryRunMode = false, anyCommandFailed = false;
+    std::vector<std::wstring> excludePatterns;
+    bool dryRunMode = false, anyCommandFailed = false, statsMode = false;
+    bool countMode = false, sumSizeMode = false, rollupMode = false;
+    std::optional<double> sampleFraction;
+    std::optional<std::wstring> snapshotPath;
+    std::optional<std::wstring> diffDirectory;
+    std::optional<size_t> perDirectoryLimit;
+    bool perDirectoryTop = true;
+    bool dedupLinksMode = false;
+    bool diffContentMode = false;
+    std::optional<size_t> threadCount;
+    bool adaptiveThreads = false;
+    std::optional<std::wstring> listSource;
+    bool followMode = false;
+    bool backgroundMode = false;
+    std::optional<double> paceRate;
+    std::optional<size_t> rollupDepth;
+    std::optional<GroupField> groupField;
+    std::optional<HistogramKind> histogramKind;
+    bool jsonMode = false;
+    bool quantilesMode = false;
+    std::optional<GroupField> distinctField;
 
     std::optional<std::chrono::system_clock::time_point> dateCreatedStart, dateCreatedEnd;
     std::optional<std::chrono::system_clock::time_point> dateModifiedStart, dateModifiedEnd;
+    std::optional<uintmax_t> minSize, maxSize;
 
     if (argc_w < 2) { /* Let positional arg check handle */ }
     else if (strEqualsAny(args[1], {L"-h", L"--help", L"/?"})) {
@@ -631,11 +3832,110 @@ int main(int /*argc_c*/, char* /*argv_c*/[]) {
         else if (strEqualsAny(arg, {L"-v", L"--verbose"})) verboseMode = true;
         else if (strEqualsAny(arg, {L"-P", L"--path-match"})) pathMatchMode = true;
         else if (strEqualsAny(arg, {L"--dry-run"})) dryRunMode = true;
+        else if (strEqualsAny(arg, {L"--stats"})) statsMode = true;
+        else if (strEqualsAny(arg, {L"--count"})) countMode = true;
+        else if (strEqualsAny(arg, {L"--per-dir-top", L"--per-dir-rest"})) {
+            bool top = (arg == L"--per-dir-top");
+            if (perDirectoryLimit && perDirectoryTop != top) { std::wcerr << L"Error: --per-dir-top and --per-dir-rest cannot be combined." << std::endl; LocalFree(argv_w); return 1; }
+            std::optional<uint64_t> limit;
+            if (++i < args.size() && (limit = parseCount(args[i])) && *limit <= SIZE_MAX) {
+                perDirectoryLimit = static_cast<size_t>(*limit);
+                perDirectoryTop = top;
+            }
+            else { std::wcerr << L"Error: " << arg << L" requires a number." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--diff"})) {
+            if (++i < args.size()) diffDirectory = args[i];
+            else { std::wcerr << L"Error: --diff requires a directory argument." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--diff-content"})) diffContentMode = true;
+        else if (strEqualsAny(arg, {L"--dedup-links"})) dedupLinksMode = true;
+        else if (strEqualsAny(arg, {L"--follow"})) followMode = true;
+        else if (strEqualsAny(arg, {L"--background"})) backgroundMode = true;
+        else if (strEqualsAny(arg, {L"--pace"})) {
+            if (++i < args.size()) {
+                wchar_t* end = nullptr;
+                double rate = wcstod(args[i].c_str(), &end);
+                if (args[i].empty() || *end || !(rate > 0)) { std::wcerr << L"Invalid rate for --pace (use a number of operations per second above 0)." << std::endl; LocalFree(argv_w); return 1; }
+                paceRate = rate;
+            }
+            else { std::wcerr << L"Error: --pace requires an argument." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--from-list"})) {
+            if (++i < args.size() && !args[i].empty()) listSource = args[i];
+            else { std::wcerr << L"Error: --from-list requires a file argument (or - for standard input)." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--threads"})) {
+            if (++i < args.size() && strEqualsAny(args[i], {L"auto"})) {
+                adaptiveThreads = true;
+                threadCount.reset();
+            }
+            else if (auto count = (i < args.size()) ? parseCount(args[i]) : std::nullopt; count && *count > 0 && *count <= SIZE_MAX) {
+                threadCount = static_cast<size_t>(*count);
+                adaptiveThreads = false;
+            }
+            else { std::wcerr << L"Error: --threads requires a positive number or auto." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--snapshot"})) {
+            if (++i < args.size()) snapshotPath = args[i];
+            else { std::wcerr << L"Error: --snapshot requires a file argument." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--sample"})) {
+            if (++i < args.size()) {
+                std::wstring percentStr = args[i];
+                if (!percentStr.empty() && percentStr.back() == L'%') percentStr.pop_back();
+                wchar_t* end = nullptr;
+                double percent = wcstod(percentStr.c_str(), &end);
+                if (percentStr.empty() || *end || !(percent > 0 && percent <= 100)) { std::wcerr << L"Invalid percentage for --sample (use a number above 0 and up to 100)." << std::endl; LocalFree(argv_w); return 1; }
+                sampleFraction = percent / 100;
+            }
+            else { std::wcerr << L"Error: --sample requires an argument." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--sum-size"})) sumSizeMode = true;
+        else if (strEqualsAny(arg, {L"--group-by"})) {
+            if (++i < args.size()) { if (auto field = parseGroupField(args[i])) groupField = field; else {std::wcerr << L"Invalid field for --group-by (use ext, dir, owner or mtime-month)." << std::endl; LocalFree(argv_w); return 1;}}
+            else { std::wcerr << L"Error: --group-by requires an argument." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--histogram"})) {
+            if (++i < args.size()) {
+                if (args[i] == L"size") histogramKind = HistogramKind::Size;
+                else if (args[i] == L"age") histogramKind = HistogramKind::Age;
+                else { std::wcerr << L"Invalid kind for --histogram (use size or age)." << std::endl; LocalFree(argv_w); return 1; }
+            }
+            else { std::wcerr << L"Error: --histogram requires an argument." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--quantiles"})) {
+            if (++i < args.size()) {
+                if (args[i] == L"size") quantilesMode = true;
+                else { std::wcerr << L"Invalid field for --quantiles (use size)." << std::endl; LocalFree(argv_w); return 1; }
+            }
+            else { std::wcerr << L"Error: --quantiles requires an argument." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--distinct"})) {
+            if (++i < args.size()) { if (auto field = parseGroupField(args[i])) distinctField = field; else {std::wcerr << L"Invalid field for --distinct (use ext, dir, owner or mtime-month)." << std::endl; LocalFree(argv_w); return 1;}}
+            else { std::wcerr << L"Error: --distinct requires an argument." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--json"})) {
+            jsonMode = true;
+        }
+        else if (strEqualsAny(arg, {L"--rollup"})) {
+            rollupMode = true;
+            // Optional depth argument
+            if (i + 1 < args.size() && !args[i + 1].empty() && std::all_of(args[i + 1].begin(), args[i + 1].end(), iswdigit)) {
+                auto depth = parseCount(args[++i]);
+                if (!depth || *depth > SIZE_MAX) { std::wcerr << L"Invalid depth for --rollup." << std::endl; LocalFree(argv_w); return 1; }
+                rollupDepth = static_cast<size_t>(*depth);
+            }
+        }
         else if (strEqualsAny(arg, {L"-8", L"--utf8"})) { /* already processed early */ }
         else if (strEqualsAny(arg, {L"-x", L"--execute"})) {
             if (++i < args.size()) command = args[i];
             else { std::wcerr << L"Error: --execute requires an argument." << std::endl; LocalFree(argv_w); return 1; }
         }
+        else if (strEqualsAny(arg, {L"--exclude"})) {
+            if (++i < args.size()) excludePatterns.push_back(args[i]);
+            else { std::wcerr << L"Error: --exclude requires an argument." << std::endl; LocalFree(argv_w); return 1; }
+        }
         else if (strEqualsAny(arg, {L"--sort"})) {
             if (++i < args.size()) sortOption = args[i];
             else { std::wcerr << L"Error: --sort requires an argument." << std::endl; LocalFree(argv_w); return 1; }
@@ -656,20 +3956,66 @@ int main(int /*argc_c*/, char* /*argv_c*/[]) {
             if (++i < args.size()) { if (auto dt = parseDateTime(args[i])) dateModifiedEnd = dt; else {std::wcerr << L"Invalid date for --date-modified-end." << std::endl; LocalFree(argv_w); return 1;}}
             else { std::wcerr << L"Error: --date-modified-end requires an argument." << std::endl; LocalFree(argv_w); return 1; }
         }
+        else if (strEqualsAny(arg, {L"--min-size"})) {
+            if (++i < args.size()) { if (auto size = parseSize(args[i])) minSize = size; else {std::wcerr << L"Invalid size for --min-size." << std::endl; LocalFree(argv_w); return 1;}}
+            else { std::wcerr << L"Error: --min-size requires an argument." << std::endl; LocalFree(argv_w); return 1; }
+        }
+        else if (strEqualsAny(arg, {L"--max-size"})) {
+            if (++i < args.size()) { if (auto size = parseSize(args[i])) maxSize = size; else {std::wcerr << L"Invalid size for --max-size." << std::endl; LocalFree(argv_w); return 1;}}
+            else { std::wcerr << L"Error: --max-size requires an argument." << std::endl; LocalFree(argv_w); return 1; }
+        }
         else if (strEqualsAny(arg, {L"-h", L"--help", L"/?"})) { printUsage(args[0].c_str()); LocalFree(argv_w); return 0; }
         else if (arg[0] == L'-') { std::wcerr << L"Unknown option: " << arg << std::endl; printUsage(args[0].c_str()); LocalFree(argv_w); return 1; }
         else { positionalArgs.push_back(arg); }
     }
 
-    if (positionalArgs.empty()) { std::wcerr << L"No directory specified." << std::endl; printUsage(args[0].c_str()); LocalFree(argv_w); return 1; }
-    directory = positionalArgs[0];
-    if (positionalArgs.size() >= 2) pattern = positionalArgs[1];
-    if (positionalArgs.size() > 2) { std::wcerr << L"Too many positional arguments." << std::endl; printUsage(args[0].c_str()); LocalFree(argv_w); return 1; }
+    if (positionalArgs.empty() && !listSource) { std::wcerr << L"No directory specified." << std::endl; printUsage(args[0].c_str()); LocalFree(argv_w); return 1; }
+    if (listSource && positionalArgs.size() > 1) { std::wcerr << L"Error: with --from-list the only argument is the pattern." << std::endl; LocalFree(argv_w); return 1; }
+    // With two or more positional arguments the last one is the pattern; with --from-list the only one is
+    if (listSource) {
+        if (!positionalArgs.empty()) pattern = positionalArgs.front();
+        positionalArgs.clear();
+    } else if (positionalArgs.size() >= 2) {
+        pattern = positionalArgs.back();
+        positionalArgs.pop_back();
+    }
+    roots = eliminateOverlappingRoots(positionalArgs, shallow, debug);
 
+    bool sketchMode = quantilesMode || distinctField.has_value();
+    bool reportMode = countMode || sumSizeMode || rollupMode || groupField || histogramKind || sketchMode || snapshotPath || diffDirectory;
+    int reportKinds = (countMode || sumSizeMode) + rollupMode + groupField.has_value() + histogramKind.has_value() + sketchMode + snapshotPath.has_value() + diffDirectory.has_value();
+    if (reportKinds > 1) { std::wcerr << L"Error: use only one of --count/--sum-size, --rollup, --group-by, --histogram, --quantiles/--distinct, --snapshot and --diff." << std::endl; LocalFree(argv_w); return 1; }
+    if (reportMode && command) { std::wcerr << L"Error: --count, --sum-size, --rollup, --group-by, --histogram, --quantiles, --distinct, --snapshot and --diff cannot be combined with --execute." << std::endl; LocalFree(argv_w); return 1; }
+    if (listSource && (diffDirectory || rollupMode || perDirectoryLimit)) { std::wcerr << L"Error: --from-list cannot be combined with --diff, --rollup, --per-dir-top or --per-dir-rest." << std::endl; LocalFree(argv_w); return 1; }
+    if (followMode && (reportMode || perDirectoryLimit || listSource)) { std::wcerr << L"Error: --follow only applies to directory searches that list files or --execute." << std::endl; LocalFree(argv_w); return 1; }
+    if (followMode && verboseMode && !command) { std::wcerr << L"Error: --follow cannot be combined with -v (the grouped listing needs every file up front)." << std::endl; LocalFree(argv_w); return 1; }
+    if (reportMode && perDirectoryLimit) { std::wcerr << L"Error: --per-dir-top and --per-dir-rest only apply to file listings and --execute." << std::endl; LocalFree(argv_w); return 1; }
+    if (diffDirectory && roots.size() > 1) { std::wcerr << L"Error: --diff compares a single directory with <dir2>." << std::endl; LocalFree(argv_w); return 1; }
+    if (paceRate && diffDirectory) { std::wcerr << L"Error: --pace cannot be combined with --diff." << std::endl; LocalFree(argv_w); return 1; }
+    if (diffDirectory && (pathMatchMode || dedupLinksMode || minSize || maxSize || dateCreatedStart || dateCreatedEnd || dateModifiedStart || dateModifiedEnd)) {
+        std::wcerr << L"Error: --diff cannot be combined with -P, --dedup-links, --min-size, --max-size or the date filters." << std::endl; LocalFree(argv_w); return 1;
+    }
+    if (diffContentMode && !diffDirectory) { std::wcerr << L"Error: --diff-content requires --diff." << std::endl; LocalFree(argv_w); return 1; }
+    if (useRegex && !excludePatterns.empty() && (PatternMatcher::hasBackreference(pattern) ||
+        std::any_of(excludePatterns.begin(), excludePatterns.end(), PatternMatcher::hasBackreference))) {
+        std::wcerr << L"Error: regex patterns with backreferences cannot be combined with --exclude." << std::endl; LocalFree(argv_w); return 1;
+    }
+    if (sampleFraction && !(countMode || sumSizeMode)) { std::wcerr << L"Error: --sample requires --count or --sum-size." << std::endl; LocalFree(argv_w); return 1; }
+    if (jsonMode && !histogramKind && !sketchMode) { std::wcerr << L"Error: --json is only supported with --histogram, --quantiles and --distinct." << std::endl; LocalFree(argv_w); return 1; }
     if (dryRunMode && !command) std::wcerr << L"Warning: --dry-run specified without --execute." << std::endl;
 
+    // Default thread counts follow the processors this process may use, not the machine's
+    ResourceBudget budget = detectResourceBudget();
+    size_t processorCount = budget.processors;
+    // Threads far beyond the processors gain nothing even on slow storage, and too many cannot be created
+    const size_t maxThreads = std::max<size_t>(64, processorCount * 8);
+    if (threadCount && *threadCount > maxThreads) {
+        std::wcerr << L"Error: --threads requires a positive number (at most " << maxThreads << L") or auto." << std::endl; LocalFree(argv_w); return 1;
+    }
+
     if (debug) {
-        std::wcout << L"Searching in directory: " << directory << L"\nPattern: " << pattern << std::endl;
+        for (const auto& root : roots) std::wcout << L"Searching in directory: " << root << std::endl;
+        std::wcout << L"Pattern: " << pattern << std::endl;
         if (useRegex) std::wcout << L"Using regex pattern matching" << std::endl;
         if (shallow) std::wcout << L"Performing shallow search" << std::endl;
         if (singleTabMode) std::wcout << L"Using single tab formatting" << std::endl;
@@ -680,6 +4026,7 @@ int main(int /*argc_c*/, char* /*argv_c*/[]) {
         if (dryRunMode) std::wcout << L"Dry-run mode enabled" << std::endl;
         if (command) std::wcout << L"Command to execute: " << *command << std::endl;
         if (sortOption) std::wcout << L"Sort option: " << *sortOption << std::endl;
+        for (const auto& exclude : excludePatterns) std::wcout << L"Exclude pattern: " << exclude << std::endl;
         auto print_debug_date = [](const wchar_t* name, const auto& optDate) {
             if(optDate){
                 auto tt = std::chrono::system_clock::to_time_t(*optDate);
@@ -694,49 +4041,338 @@ int main(int /*argc_c*/, char* /*argv_c*/[]) {
         print_debug_date(L"Date created end:   ", dateCreatedEnd);
         print_debug_date(L"Date modified start: ", dateModifiedStart);
         print_debug_date(L"Date modified end:   ", dateModifiedEnd);
+        if (minSize) std::wcout << L"Minimum size: " << *minSize << L" bytes" << std::endl;
+        if (maxSize) std::wcout << L"Maximum size: " << *maxSize << L" bytes" << std::endl;
+        if (diffDirectory) std::wcout << L"Comparing with directory: " << *diffDirectory << (diffContentMode ? L" (including content)" : L"") << std::endl;
+        if (dedupLinksMode) std::wcout << L"Counting hard-linked files once" << std::endl;
+        if (threadCount) std::wcout << L"Walker threads: " << *threadCount << std::endl;
+        if (adaptiveThreads) std::wcout << L"Walker threads: adaptive" << std::endl;
+        std::wcout << L"Processors available: " << budget.processors << L" of " << budget.machineProcessors << std::endl;
+        if (NumaTopology::get().multiNode()) std::wcout << L"NUMA nodes: " << NumaTopology::get().nodes.size() << L" (worker threads spread across them)" << std::endl;
+        if (budget.memory) std::wcout << L"Memory available: " << budget.memory / (1024 * 1024) << L" MB" << (budget.memoryLimited ? L" (job limit)" : L"") << std::endl;
+        if (listSource) std::wcout << L"Reading paths from: " << *listSource << std::endl;
+        if (followMode) std::wcout << L"Following new and modified files" << std::endl;
+        if (backgroundMode) std::wcout << L"Running at background priority" << std::endl;
+        if (paceRate) std::wcout << L"Pace: " << *paceRate << L" operations per second" << std::endl;
+        if (perDirectoryLimit) std::wcout << (perDirectoryTop ? L"First " : L"All but the first ") << *perDirectoryLimit << L" files per directory" << std::endl;
+        if (snapshotPath) std::wcout << L"Snapshot file: " << *snapshotPath << std::endl;
+        if (sampleFraction) std::wcout << L"Sampling " << *sampleFraction * 100 << L"% of files" << std::endl;
+    }
+
+    if (backgroundMode) {
+        // Background mode lowers I/O and memory priority; the priority class also reaches --execute commands
+        SetPriorityClass(GetCurrentProcess(), BELOW_NORMAL_PRIORITY_CLASS);
+        if (!SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN)) {
+            std::wcerr << L"Warning: could not enter background mode (error " << GetLastError() << L")." << std::endl;
+        }
+    }
+
+    SearchOptions searchOptions;
+    searchOptions.useRegex = useRegex;
+    searchOptions.shallow = shallow;
+    searchOptions.debug = debug;
+    searchOptions.pathMatch = pathMatchMode;
+    searchOptions.excludes = excludePatterns;
+    searchOptions.dedupLinks = dedupLinksMode;
+    searchOptions.pace = paceRate.value_or(0);
+    if (!threadCount && roots.size() > 1 && !listSource) adaptiveThreads = true;
+    if (adaptiveThreads) {
+        // Room to climb well past the processor count, since most of the time is spent waiting on I/O
+        searchOptions.threads = std::clamp<size_t>(processorCount * 4, 8, 64);
+        searchOptions.adaptiveStart = processorCount;
+    } else {
+        searchOptions.threads = threadCount.value_or(listSource ? processorCount : 1);
+    }
+    if (dateCreatedStart) searchOptions.filter.createdStart = timePointToFileTimeTicks(*dateCreatedStart);
+    if (dateCreatedEnd) searchOptions.filter.createdEnd = timePointToFileTimeTicks(*dateCreatedEnd);
+    if (dateModifiedStart) searchOptions.filter.modifiedStart = timePointToFileTimeTicks(*dateModifiedStart);
+    if (dateModifiedEnd) searchOptions.filter.modifiedEnd = timePointToFileTimeTicks(*dateModifiedEnd);
+    searchOptions.filter.minSize = minSize;
+    searchOptions.filter.maxSize = maxSize;
+    if (sampleFraction && *sampleFraction < 1) searchOptions.filter.sampleThreshold = static_cast<uint64_t>(std::ldexp(*sampleFraction, 64));
+
+    PathListReader pathList;
+    if (listSource && !pathList.open(*listSource)) {
+        std::wcerr << L"Error: Could not open path list: " << *listSource << std::endl;
+        LocalFree(argv_w);
+        return 1;
+    }
+    // Listed paths only get sizes and times when a filter, sort key, report or output column needs them
+    bool listPathsOnly = !(dateCreatedStart || dateCreatedEnd || dateModifiedStart || dateModifiedEnd || minSize || maxSize)
+        && !(sortOption && sortOption->find_first_of(L"scm") != std::wstring::npos)
+        && (reportMode ? (countMode && !sumSizeMode && !sampleFraction && !groupField && !histogramKind && !sketchMode && !snapshotPath)
+                       : (command || (bareMode && !verboseMode)));
+    auto runSearch = [&](auto& sink) {
+        return listSource ? FileFinder::searchList(pathList, pattern, searchOptions, !listPathsOnly, sink)
+                          : FileFinder::search(roots, pattern, searchOptions, sink);
+    };
+
+    SearchStats searchStats;
+    auto searchStart = std::chrono::steady_clock::now();
+
+    if (diffDirectory) {
+        std::optional<PatternMatcher> matcher;
+        try {
+            matcher.emplace(pattern, excludePatterns, useRegex, false);
+        } catch (const std::regex_error& e) {
+            std::string what_str = e.what();
+            std::wcerr << L"Invalid regex pattern: " << std::wstring(what_str.begin(), what_str.end()) << std::endl;
+            LocalFree(argv_w);
+            return 1;
+        }
+        for (const std::wstring& directory : { roots.front(), *diffDirectory }) {
+            DWORD attributes = GetFileAttributesW(directory.c_str());
+            if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                std::wcerr << L"Error: Directory not found: " << directory << std::endl;
+                LocalFree(argv_w);
+                return 1;
+            }
+        }
+        TreeDiff treeDiff(*matcher, diffContentMode, shallow);
+        WorkerPool pool(threadCount.value_or(processorCount));
+        std::vector<TreeDiff::Difference> differences = treeDiff.run(roots.front(), *diffDirectory, pool);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - searchStart;
+        printTreeDifferences(differences, singleTabMode, conciseMode, bareMode);
+        if (statsMode) {
+            searchStats.directories = treeDiff.directories;
+            searchStats.entries = treeDiff.files;
+            searchStats.matches = differences.size();
+            printSearchStats(searchStats, elapsed.count());
+        }
+        LocalFree(argv_w);
+        return 0;
+    }
+
+    if (snapshotPath) {
+        // The new snapshot is written next to the old one and only replaces it once complete
+        std::wstring newPath = *snapshotPath + L".tmp";
+        BinaryFile newFile;
+        SnapshotHeader placeholder = {};
+        if (!newFile.open(newPath, true) || !newFile.write(&placeholder, sizeof(placeholder))) {
+            std::wcerr << L"Error: Could not create snapshot file: " << newPath << std::endl;
+            LocalFree(argv_w);
+            return 1;
+        }
+        // The scope covers everything that decides which files match, so a snapshot taken with other
+        // settings is never diffed against. Options left at their defaults add nothing, which keeps
+        // snapshots written before they were part of the scope valid.
+        std::wstring scopeKey;
+        for (const auto& root : roots) scopeKey += root + L'|';
+        if (listSource) scopeKey += *listSource + L'|';
+        scopeKey += pattern;
+        std::wstringstream matchKey;
+        if (useRegex) matchKey << L"|regex";
+        if (pathMatchMode) matchKey << L"|path";
+        if (shallow) matchKey << L"|shallow";
+        if (dedupLinksMode) matchKey << L"|links";
+        for (const auto& exclude : excludePatterns) matchKey << L"|exclude:" << exclude;
+        const EntryFilter& filter = searchOptions.filter;
+        auto bound = [&matchKey](const wchar_t* name, const auto& value) {
+            if (value) matchKey << L'|' << name << L':' << *value;
+        };
+        bound(L"created>=", filter.createdStart);
+        bound(L"created<=", filter.createdEnd);
+        bound(L"modified>=", filter.modifiedStart);
+        bound(L"modified<=", filter.modifiedEnd);
+        bound(L"size>=", filter.minSize);
+        bound(L"size<=", filter.maxSize);
+        uint64_t scope = hash64(scopeKey + matchKey.str());
+        SnapshotSink sink(newFile);
+        searchStats = runSearch(sink);
+        uint64_t blobLength = 0;
+        for (const auto& record : sink.records) blobLength += record.pathLength();
+        if (!sink.ok || !Snapshot::finish(newFile, sink.records, scope, blobLength)) {
+            std::wcerr << L"Error: Could not write snapshot file: " << newPath << std::endl;
+            newFile.close();
+            DeleteFileW(newPath.c_str());
+            LocalFree(argv_w);
+            return 1;
+        }
+
+        BinaryFile oldFile;
+        SnapshotHeader oldHeader = {};
+        bool haveOld = oldFile.open(*snapshotPath, false);
+        if (haveOld && !Snapshot::readHeader(oldFile, oldHeader)) {
+            std::wcerr << L"Warning: " << *snapshotPath << L" is not a snapshot file; reporting all files as added." << std::endl;
+            haveOld = false;
+        } else if (haveOld && oldHeader.scope != scope) {
+            std::wcerr << L"Warning: snapshot was taken for a different directory, pattern or filter options; reporting all files as added." << std::endl;
+            haveOld = false;
+        }
+        std::vector<SnapshotChange> changes = Snapshot::diff(haveOld ? &oldFile : nullptr, oldHeader, sink.records);
+        if (!newFile.open(newPath, false)) {
+            std::wcerr << L"Error: Could not reopen snapshot file: " << newPath << std::endl;
+            oldFile.close();
+            DeleteFileW(newPath.c_str());
+            LocalFree(argv_w);
+            return 1;
+        }
+        Snapshot::resolvePaths(changes, haveOld ? &oldFile : nullptr, newFile);
+        oldFile.close();
+        newFile.close();
+        std::sort(changes.begin(), changes.end(), [](const SnapshotChange& a, const SnapshotChange& b) { return a.path < b.path; });
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - searchStart;
+        printSnapshotChanges(changes, singleTabMode, conciseMode, bareMode);
+        if (!MoveFileExW(newPath.c_str(), snapshotPath->c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+            std::wcerr << L"Error: Could not replace snapshot file: " << *snapshotPath << std::endl;
+        }
+        if (statsMode) printSearchStats(searchStats, elapsed.count());
+        LocalFree(argv_w);
+        return 0;
+    }
+
+    if (sampleFraction) {
+        SampleSink sink;
+        searchStats = runSearch(sink);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - searchStart;
+        printSampleEstimate(sink, *sampleFraction, !sumSizeMode, singleTabMode, conciseMode);
+        if (statsMode) printSearchStats(searchStats, elapsed.count());
+        LocalFree(argv_w);
+        return 0;
+    }
+
+    if (countMode || sumSizeMode) {
+        AggregateSink sink;
+        searchStats = runSearch(sink);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - searchStart;
+        printAggregateSummary(sink.totals, !sumSizeMode, singleTabMode, conciseMode);
+        if (statsMode) printSearchStats(searchStats, elapsed.count());
+        LocalFree(argv_w);
+        return 0;
+    }
+
+    if (rollupMode) {
+        RollupSink sink;
+        searchStats = runSearch(sink);
+        std::vector<AggregateRow> rows = sink.rollup(roots, rollupDepth);
+        sortAggregateRows(rows, parseSortOptions(sortOption.value_or(L"-s")));
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - searchStart;
+        printAggregateRows(rows, L"Directory", L"directories", singleTabMode, conciseMode, bareMode);
+        if (statsMode) printSearchStats(searchStats, elapsed.count());
+        LocalFree(argv_w);
+        return 0;
+    }
+
+    if (sketchMode) {
+        SketchSink sink(quantilesMode, distinctField);
+        searchStats = runSearch(sink);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - searchStart;
+        printSketchReport(sink, quantilesMode, distinctField, singleTabMode, conciseMode, jsonMode);
+        if (statsMode) printSearchStats(searchStats, elapsed.count());
+        LocalFree(argv_w);
+        return 0;
     }
 
-    std::vector<FileInfo> results = FileFinder::findFiles(directory, pattern, useRegex, shallow, debug, pathMatchMode);
-    if (dateCreatedStart || dateCreatedEnd || dateModifiedStart || dateModifiedEnd) {
-        results = filterFilesByDate(results, dateCreatedStart, dateCreatedEnd, dateModifiedStart, dateModifiedEnd);
+    if (histogramKind) {
+        HistogramSink sink(*histogramKind, timePointToFileTimeTicks(std::chrono::system_clock::now()));
+        searchStats = runSearch(sink);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - searchStart;
+        printHistogram(sink.buckets(), *histogramKind, singleTabMode, conciseMode, jsonMode);
+        if (statsMode) printSearchStats(searchStats, elapsed.count());
+        LocalFree(argv_w);
+        return 0;
     }
-    if (sortOption) {
-        sortFiles(results, parseSortOptions(*sortOption));
+
+    if (groupField) {
+        GroupBySink sink(*groupField);
+        searchStats = runSearch(sink);
+        std::vector<AggregateRow> rows = sink.rows();
+        bool byMonth = (*groupField == GroupField::ModifiedMonth);
+        sortAggregateRows(rows, parseSortOptions(sortOption.value_or(byMonth ? L"p" : L"-s")));
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - searchStart;
+        const wchar_t* header = L"Extension";
+        switch (*groupField) {
+            case GroupField::Extension: header = L"Extension"; break;
+            case GroupField::Directory: header = L"Directory"; break;
+            case GroupField::Owner: header = L"Owner"; break;
+            case GroupField::ModifiedMonth: header = L"Month"; break;
+        }
+        printAggregateRows(rows, header, L"groups", singleTabMode, conciseMode, bareMode);
+        if (statsMode) printSearchStats(searchStats, elapsed.count());
+        LocalFree(argv_w);
+        return 0;
     }
 
     bool isExecutingCommand = command.has_value();
     bool isDryRunExecute = isExecutingCommand && dryRunMode;
 
-    if (!isExecutingCommand && !bareMode) {
-        if (verboseMode && conciseMode) { // Global headers for verbose-concise
-             if (!conciseMode) printColumnHeaders(singleTabMode, true);
-        } else if (!verboseMode && !conciseMode) { // Global headers for normal non-verbose
-            printColumnHeaders(singleTabMode, false);
+    // A path-first sort is produced by walking in order, and plain listings then stream. --execute
+    // still collects first, so commands that add or rename files cannot feed back into the walk.
+    std::vector<SortOption> sortOptions = parseSortOptions(sortOption.value_or(L""));
+    bool pathOrdered = sortOption && sortOptions.front().field == SortField::Path && !perDirectoryLimit && !listSource;
+    if (pathOrdered) searchOptions.pathOrder = sortOptions.front().ascending ? 1 : -1;
+    bool streamResults = pathOrdered && !verboseMode && !isExecutingCommand;
+
+    auto printListingHeaders = [&]() {
+        if (!isExecutingCommand && !bareMode) {
+            if (verboseMode && conciseMode) { // Global headers for verbose-concise
+                 if (!conciseMode) printColumnHeaders(singleTabMode, true);
+            } else if (!verboseMode && !conciseMode) { // Global headers for normal non-verbose
+                printColumnHeaders(singleTabMode, false);
+            }
+            // Normal verbose prints headers per-directory. Concise non-verbose prints no headers.
         }
-        // Normal verbose prints headers per-directory. Concise non-verbose prints no headers.
-    }
 
-    if (isExecutingCommand && !bareMode) {
-        std::wcout << L"Executing" << (isDryRunExecute ? L" (dry run)" : L"") << std::endl;
-        std::wcout << std::wstring(isDryRunExecute ? 19 : 9, L'-') << std::endl;
+        if (isExecutingCommand && !bareMode) {
+            std::wcout << L"Executing" << (isDryRunExecute ? L" (dry run)" : L"") << std::endl;
+            std::wcout << std::wstring(isDryRunExecute ? 19 : 9, L'-') << std::endl;
+        }
+    };
+    std::optional<FollowWatcher> follower;
+    auto emitFile = [&](const FileInfo& file) {
+        if (isExecutingCommand) {
+            if (!executeCommand(*command, file, dryRunMode, debug)) anyCommandFailed = true;
+        } else {
+            printFileInfo(file, singleTabMode, bareMode, false, conciseMode, L"", L"");
+        }
+        if (follower) follower->remember(file);
+    };
+    if (followMode) {
+        follower.emplace(roots, pattern, searchOptions, emitFile);
+        follower->start(); // Before the search, so nothing created during it is missed
     }
 
-    if (verboseMode && !isExecutingCommand) {
-        printFilesVerbose(results, singleTabMode, conciseMode, bareMode);
+    size_t fileCount = 0;
+    std::chrono::duration<double> searchElapsed;
+    if (streamResults) {
+        printListingHeaders();
+        StreamSink sink(emitFile);
+        searchStats = runSearch(sink);
+        searchElapsed = std::chrono::steady_clock::now() - searchStart;
+        fileCount = sink.count;
     } else {
-        for (const auto& file : results) {
-            if (isExecutingCommand) {
-                if (!executeCommand(*command, file, dryRunMode, debug)) anyCommandFailed = true;
-            } else {
-                printFileInfo(file, singleTabMode, bareMode, false, conciseMode, L"", L"");
-            }
+        std::vector<FileInfo> results;
+        if (perDirectoryLimit) {
+            // Already ordered within each directory; directories come out in walk order
+            PerDirectorySink sink(results, parseSortOptions(sortOption.value_or(L"-m")), *perDirectoryLimit, perDirectoryTop);
+            searchStats = runSearch(sink);
+        } else {
+            CollectSink sink;
+            searchStats = runSearch(sink);
+            results = std::move(sink.results);
+        }
+        searchElapsed = std::chrono::steady_clock::now() - searchStart;
+        if (sortOption && !perDirectoryLimit && !pathOrdered) {
+            sortFiles(results, sortOptions);
+        } else if (searchOptions.threads > 1 && !perDirectoryLimit && !pathOrdered && !listSource) {
+            sortFiles(results, parseSortOptions(L"p")); // A parallel walk finds files in no particular order
+        }
+        fileCount = results.size();
+
+        printListingHeaders();
+        if (verboseMode && !isExecutingCommand) {
+            printFilesVerbose(results, singleTabMode, conciseMode, bareMode);
+        } else {
+            for (const auto& file : results) emitFile(file);
         }
     }
 
-    if (isDryRunExecute) {
-        std::wcout << L"Dry run: " << results.size() << L" commands would be generated." << std::endl;
+    if (followMode) {
+        // No summary: the listing continues with every new or changed match until interrupted
+    } else if (isDryRunExecute) {
+        std::wcout << L"Dry run: " << fileCount << L" commands would be generated." << std::endl;
     } else if (isExecutingCommand) {
-        std::wcout << results.size() << L" files processed for command execution." << std::endl;
+        std::wcout << fileCount << L" files processed for command execution." << std::endl;
         if (anyCommandFailed) std::wcout << L"One or more command executions failed." << std::endl;
     } else if (!conciseMode) {
         if (!verboseMode || (verboseMode && conciseMode)) { // Print summary if not normal-verbose
@@ -769,10 +4405,18 @@ int main(int /*argc_c*/, char* /*argv_c*/[]) {
             }
         }
         if (!verboseMode || conciseMode) { // Avoid global summary for normal verbose
-            std::wcout << L"Found " << results.size() << L" files" << std::endl;
+            std::wcout << L"Found " << fileCount << L" files" << std::endl;
         }
     }
 
+    if (statsMode) printSearchStats(searchStats, searchElapsed.count());
+
+    if (follower) {
+        follower->run();
+        LocalFree(argv_w);
+        return 1; // Following only ends when no directory can be watched any more
+    }
+
     LocalFree(argv_w);
     return anyCommandFailed ? 1 : 0;
 }